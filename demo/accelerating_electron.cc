@@ -57,7 +57,7 @@ int main() {
 	/* Set the mass of the electron to be the literature value. We have to
 	 * mess around with vectors because this is technically the 0th object
 	 * in a system of 1 object(s). */
-	std::get<std::vector<double>>(sandbox.database_get("mass"))[0]
+	std::get<libSphysl::column_t<double>>(sandbox.database_get("mass"))[0]
 		= 9.10938188 * std::pow(10.0, -31.0); // kilogrammes.
 
 	/* Create an engine for the display function and add it to the
@@ -102,15 +102,15 @@ void display(void *arg) {
 	 * simulation system. (Note: We are getting a reference to the first
 	 * and only entitie's values, hence the vector element access.) */
 
-	static const auto& v = std::get<std::vector<double>>(
+	static const auto& v = std::get<libSphysl::column_t<double>>(
 		sandbox.database_get("x velocity")
 	)[0];
 
-	static const auto& a = std::get<std::vector<double>>(
+	static const auto& a = std::get<libSphysl::column_t<double>>(
 		sandbox.database_get("x acceleration")
 	)[0];
 
-	static const auto& m = std::get<std::vector<double>>(
+	static const auto& m = std::get<libSphysl::column_t<double>>(
 		sandbox.database_get("mass")
 	)[0];
 
@@ -144,7 +144,7 @@ void field(void *arg) {
 	 * (Note: We are getting a reference to the first and only entitie's
 	 * values, hence the vector element access.) */
 
-	static auto& F = std::get<std::vector<double>>(
+	static auto& F = std::get<libSphysl::column_t<double>>(
 		sandbox.database_get("x force")
 	)[0];
 
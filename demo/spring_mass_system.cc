@@ -57,8 +57,9 @@ int main() {
 	 * using the x-axis of the simulation in this demonstration. We have to
 	 * mess around with vectors because this is technically the 0th object
 	 * in a system of 1 object(s). */
-	std::get<std::vector<double>>(sandbox.database_get("x position"))[0]
-		= -1.0; // metres.
+	std::get<libSphysl::column_t<double>>(
+		sandbox.database_get("x position")
+	)[0] = -1.0; // metres.
 
 	/* Notably, the mass is already set to 1 Kg by default. */
 
@@ -100,11 +101,11 @@ void display(void *arg) {
 	 * simulation system. (Note: We are getting a reference to the first
 	 * and only entitie's values, hence the vector element access.) */
 
-	static const auto& x = std::get<std::vector<double>>(
+	static const auto& x = std::get<libSphysl::column_t<double>>(
 		sandbox.database_get("x position")
 	)[0];
 
-	static const auto& v = std::get<std::vector<double>>(
+	static const auto& v = std::get<libSphysl::column_t<double>>(
 		sandbox.database_get("x velocity")
 	)[0];
 
@@ -135,11 +136,11 @@ void spring(void *arg) {
 	 * simulation system. (Note: We are getting a reference to the first
 	 * and only entitie's values, hence the vector element access.) */
 
-	static const auto& x = std::get<std::vector<double>>(
+	static const auto& x = std::get<libSphysl::column_t<double>>(
 		sandbox.database_get("x position")
 	)[0];
 
-	static auto& F = std::get<std::vector<double>>(
+	static auto& F = std::get<libSphysl::column_t<double>>(
 		sandbox.database_get("x force")
 	)[0];
 
@@ -20,12 +20,14 @@
 #include <cstddef>
 
 #include <complex>
+#include <condition_variable>
 #include <functional>
 #include <list>
 #include <map>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -42,7 +44,7 @@ namespace libSphysl {
  * subversion number increased when new features are introduced. Check (version
  * == <what you need>) and (subversion >= <what you need>) for versioning. */
 
-inline const auto version = 1;
+inline const auto version = 2;
 inline const auto subversion = 0;
 inline const auto version_name = "Dust on the Floor";
 
@@ -65,25 +67,42 @@ inline const auto version_name = "Dust on the Floor";
  * new and need to be freed with delete when the engine_t's destructor is
  * called. This is done by calling the user-provided destructor function. */
 
+/* Since the arguments usually cache pointers into the database, engines need
+ * to be regenerated when the entities in the database are reordered, added or
+ * removed. For this, an engine generator can store a generator_t in the first
+ * engine it returns, along with the number of engines it returned, and the
+ * sandbox will destroy those engines and call the generator_t to replace them
+ * when needed. Engines without a generator_t are left as they are. */
+
 struct sandbox_t; // Forward declarations.
 struct engine_t;
 
 typedef std::function<void(void* arg)> calculator_t;
 typedef std::function<void(engine_t* e)> destructor_t;
+typedef std::function<std::list<engine_t>(sandbox_t* s)> generator_t;
 
 struct engine_t {
 	calculator_t calculator{};
 	std::list<void*> args{};
 
 	destructor_t destructor{};
+
+	generator_t generator{};
+	size_t span = 1; // Number of engines the generator_t replaces.
 };
 
+/* Changes to the layout of the database can't be made while the worksets are
+ * being run, so they are wrapped in task_t's and scheduled on the sandbox,
+ * which runs them in between two runs through the worksets. */
+
+typedef std::function<void(sandbox_t* s)> task_t;
+
 /* Internally, the sandbox_t manages code execution by using threads and
  * worksets. Each thread corresponds (ideally) to a single CPU core and will
  * keep running calculations from simulation start to simulation stop. While
- * doing so, a control thread will monitor progress using start and stop
- * mutexes, signal execution stop using a boolean, and change the listing on
- * each thread as worksets change. */
+ * doing so, a control thread will hand each thread its listing and wait for
+ * it to be run using a mutex and a condition variable, signal execution stop
+ * using a boolean, and change the listing on each thread as worksets change. */
 
 typedef std::pair<calculator_t, std::vector<void*>> listing_t;
 
@@ -91,7 +110,10 @@ struct thread_t {
 	listing_t* listing{}; // The listing is swapped continuously.
 
 	std::thread thread{};
-	std::mutex start{}, stop{};
+	std::mutex lock{};
+	std::condition_variable changed{};
+
+	bool running = false; // Set until the listing has been run.
 	bool finished = false;
 };
 
@@ -136,10 +158,103 @@ typedef std::pair<data_t, data_t> data_pair_t;
  * through it and only caching a pointer to the vector itself, rather than
  * having to cache pointers to every single value. */
 
+/* Vector quantities are normally stored as three columns, one per axis (e.g.
+ * "x position", "y position" and "z position"), but they can also be packed
+ * into a single column of vec3_t's (e.g. "position") so that all three
+ * components of an entity's value share a cache line. This is what you want
+ * for anything that gathers values from arbitrary entities, like pair-force
+ * calculations going through the neighbours of an entity. */
+
+struct vec3_t {
+	double x, y, z; // Value along each axis.
+};
+
+/* Large columns are memory-bound, and with the default allocator they are
+ * backed by regular 4 KiB pages, so walking through them costs a TLB miss
+ * every few hundred entities. Hence, the memory for the columns comes from a
+ * storage_t, which can instead map it with huge pages. Allocations smaller
+ * than the threshold always come from the heap, since mapping them wouldn't
+ * be worth it. */
+
+/* The huge_pages policy uses explicit huge pages (MAP_HUGETLB), which have
+ * to be reserved by the system administrator beforehand, and falls back to
+ * transparent_huge_pages if there aren't enough of them. The latter maps
+ * anonymous memory aligned to 2 MiB and advises the kernel to back it with
+ * huge pages (MADV_HUGEPAGE), and mapped_memory just maps anonymous memory
+ * without asking for anything else. */
+
+/* For databases which don't fit in memory, the file_memory policy maps every
+ * column onto its own file in the given directory, which should be on a local
+ * disk. The files are unlinked as soon as they are created, so they're cleaned
+ * up even if the program crashes, and the kernel is told that they will be
+ * read sequentially, since the engines go through their ranges of entities in
+ * order. Columns then get paged in and out as they are used, so a sandbox can
+ * be larger than the physical memory, but it's best to keep the engines which
+ * go through all of the entities with random access on small columns. */
+
+struct storage_t {
+	enum policy_t {
+		heap_memory, mapped_memory,
+		transparent_huge_pages, huge_pages, file_memory
+	};
+
+	policy_t policy = heap_memory;
+	size_t threshold = size_t{1} << 21; // bytes
+	std::string directory = "/tmp"; // Used by file_memory.
+
+	void* allocate(size_t bytes) const;
+	void deallocate(void* memory, size_t bytes) const;
+};
+
+/* The columns themselves are std::vectors that allocate their memory using
+ * a copy of the storage_t they were created with, so changing the storage_t
+ * in a sandbox_t only affects the columns created after it is changed. */
+
+template<typename T> struct allocator_t {
+	typedef T value_type;
+	storage_t storage{};
+
+	/* Allocators are copied around and rebound to other types freely,
+	 * and they all need to share the same storage_t. */
+	allocator_t() = default;
+	allocator_t(const storage_t& storage): storage{storage} {}
+
+	template<typename U> allocator_t(const allocator_t<U>& a):
+		storage{a.storage}
+	{}
+
+	/* The storage follows the memory around when containers are copied,
+	 * moved or swapped, so that it's always deallocated the right way. */
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(storage.allocate(n * sizeof(T)));
+	}
+
+	void deallocate(T* p, size_t n) {
+		storage.deallocate(p, n * sizeof(T));
+	}
+
+	/* Memory from one allocator can be deallocated by another if they
+	 * would go about it the same way. */
+	template<typename U> bool operator==(const allocator_t<U>& a) const{
+		return storage.policy == a.storage.policy
+			&& storage.threshold == a.storage.threshold;
+	}
+
+	template<typename U> bool operator!=(const allocator_t<U>& a) const{
+		return !(*this == a);
+	}
+};
+
+template<typename T> using column_t = std::vector<T, allocator_t<T>>;
+
 typedef std::variant<
-	std::vector<bool>, std::vector<size_t>, std::vector<std::intmax_t>,
-	std::vector<double>, std::vector<std::complex<double>>,
-	std::vector<binary_t>
+	column_t<bool>, column_t<size_t>, column_t<std::intmax_t>,
+	column_t<double>, column_t<std::complex<double>>,
+	column_t<binary_t>, column_t<vec3_t>
 
 > data_vector_t;
 
@@ -168,6 +283,21 @@ struct binary_t {
 typedef std::map<std::string, data_vector_t> database_t;
 typedef std::map<std::string, data_t> config_t;
 
+/* This is what a sandbox remembers about the incremental checkpoints it has
+ * saved, so that the later ones can refer back to the parts of the columns
+ * that haven't changed since. Each chunk_t is a 1 MiB piece of a column, with
+ * a hash of its contents and where in which file it was last written. */
+
+struct chunk_t {
+	uint64_t hash{};
+	size_t file{}, offset{}; // Index into checkpoint_t::files, bytes.
+};
+
+struct checkpoint_t {
+	std::vector<std::string> files{};
+	std::map<std::string, std::vector<chunk_t>> chunks{};
+};
+
 /* Constants Declarations */
 
 /* The following are stored into a sandbox_t when an engine generator needs to
@@ -183,9 +313,31 @@ inline config_t default_configs{
 	{"minimum time change", std::pow(10.0, -7.0)}, // seconds
 	{"maximum time change", std::pow(10.0, -5.0)},
 
+	{"reordering interval", size_t{1000}}, // simulation ticks
+	{"output interval", size_t{1}}, // simulation ticks
+	{"keyframe interval", size_t{100}}, // frames
+	{"viewer interval", size_t{100}}, // simulation ticks
+	{"direct output", false},
+
+	{"force partitions", size_t{16}}, // units, or 0 for one per thread
+
 	{"gravitational constant", 6.67430 * std::pow(10.0, -11.0)},
 	// Newton metre^2 / kilogramme^2
 
+	{"vacuum permittivity", 8.8541878128 * std::pow(10.0, -12.0)},
+	// farads / metre
+
+	{"opening angle", 0.5}, // ratio
+	{"expansion order", size_t{4}},
+
+	{"box size", 1.0}, // metres
+	{"mesh size", size_t{64}}, // cells
+
+	{"lennard-jones epsilon", 1.65 * std::pow(10.0, -21.0)}, // joules
+	{"lennard-jones sigma", 3.4 * std::pow(10.0, -10.0)}, // metres
+	{"lennard-jones cutoff", 8.5 * std::pow(10.0, -10.0)},
+	{"neighbour skin", 0.1}, // cutoffs
+
 	{"speed of light", 2.99792458 * std::pow(10.0, 8.0)} // metres / second
 };
 
@@ -206,7 +358,12 @@ inline config_t default_entry_values{
 	{"y force", 0.0},
 	{"z force", 0.0},
 
-	{"mass", 1.0} // kilogrammes
+	{"mass", 1.0}, // kilogrammes
+	{"charge", 0.0}, // coulombs
+
+	{"bounding box width", 0.0}, // metres
+	{"bounding box height", 0.0},
+	{"bounding box depth", 0.0}
 };
 
 /* The following defines the ranges for randomly generating data for variables
@@ -223,6 +380,8 @@ struct sandbox_t {
 	std::vector<workset_t> worksets{};
 	std::vector<thread_t> threads{};
 
+	storage_t storage{}; // Storage used for new columns.
+
 	database_t database{};
 	config_t config{};
 
@@ -254,12 +413,150 @@ struct sandbox_t {
 	void start(); // Used for starting and stopping the simulation.
 	void stop();
 
+	/* This schedules a task to run in between two runs through the
+	 * worksets, or runs it immediately if the simulation isn't running.
+	 * It's safe to call from within a calculator. Tasks that are still
+	 * pending when the simulation is stopped are run by stop(). */
+
+	std::mutex tasks_lock{};
+	std::list<task_t> tasks{};
+
+	void schedule(const task_t& task);
+
+	/* This destroys and regenerates every engine that has a generator_t,
+	 * and then rebuilds the worksets. Any state the engines were keeping
+	 * for themselves is reset in the process. If it's called again by one
+	 * of the generators, the engines are regenerated once more after the
+	 * current round is done instead. */
+
+	bool regenerating = false, stale = false;
+	void regenerate();
+
 	/* These functions finds entries in a sandbox_t and return them, but if
  	 * they don't exist, they generate them using the default values
  	 * specified above. */
 
 	data_t& config_get(const std::string& id);
 	data_vector_t& database_get(const std::string& id);
+
+	/* Columns which have the same value for every entity don't need to be
+	 * stored as full vectors. A column is uniform if it isn't in the
+	 * database yet and either has a value in uniforms or has a default
+	 * value with no default range. Engine generators that only read a
+	 * column can check database_uniform() and cache a reference to the
+	 * single value returned by uniform_get() instead. */
+
+	/* The column is materialised into a full vector the first time it is
+	 * fetched with database_get(), since it may be written to, and the
+	 * engines are regenerated so none of them keep using the old value.
+	 * Hence, fetch the columns you want to set up before starting the
+	 * simulation, or from within a task (see schedule() below). */
+
+	config_t uniforms{};
+
+	bool database_uniform(const std::string& id) const;
+	data_t& uniform_get(const std::string& id);
+
+	/* This packs the columns "x <id>", "y <id>" and "z <id>" into a single
+	 * column of vec3_t's stored as "<id>", removing the per-axis columns.
+	 * Afterwards, the per-axis names are kept in axes as aliases for the
+	 * respective component of the packed column, so they can still be
+	 * sliced with libSphysl::utility::get_axis(). However, calling
+	 * database_get() on them will throw std::invalid_argument since there
+	 * no longer is a column_t<double> to return. */
+
+	std::map<std::string, std::pair<std::string, size_t>> axes{};
+	void database_pack(const std::string& id);
+
+	/* This reorders the rows of every column in the database, such that
+	 * row i ends up holding what was in row order[i], and regenerates the
+	 * engines. The vectors aren't reallocated, so pointers into them stay
+	 * valid, but they now point to different entities. It throws
+	 * std::invalid_argument if the order isn't a permutation of the rows,
+	 * leaving the database as it was. */
+
+	/* To keep track of which entity is which, the first reordering adds a
+	 * column "entity id" (size_t) holding each entity's original row, and
+	 * entity_row() returns the row an entity with a given id is now in. */
+
+	std::vector<size_t> rows{}; // Indexed by entity id.
+
+	void database_reorder(const std::vector<size_t>& order);
+	size_t entity_row(size_t id) const;
+
+	/* These add entities to the end of the database, filling in their
+	 * values with the defaults, or remove the entities with the given ids
+	 * by compacting every column, updating "entity count" and regenerating
+	 * the engines in either case. The changes are made in between two runs
+	 * through the worksets (see schedule() above), so they can be called
+	 * from within a calculator. */
+
+	/* New entities get the ids after the last one that was handed out,
+	 * i.e. starting at rows.size() at the time the entities are added,
+	 * and entity_row() returns SIZE_MAX for entities that were removed.
+	 * Ids that haven't been handed out yet, or whose entities have been
+	 * removed already, are ignored by remove_entities(). Note that adding
+	 * entities will usually reallocate the columns. */
+
+	void add_entities(size_t count);
+	void remove_entities(const std::vector<size_t>& ids);
+
+	/* These save the config, uniforms and database of the sandbox to a
+	 * binary checkpoint file, and load them back in. Every column is dumped
+	 * as is, with writes that are all in flight at once, at an offset
+	 * aligned to 4 KiB (see io::writer_t, which uses the config value
+	 * "direct output"), and the file is mapped into memory again when
+	 * it's loaded, so checkpoints cost little more than the disk
+	 * bandwidth. The values in the file are native-endian, so they can
+	 * only be loaded on similar machines. Both functions throw
+	 * std::runtime_error if something goes wrong. */
+
+	/* Loading replaces every column in the database (using the current
+	 * storage) and overwrites the config values in the file, leaving the
+	 * others alone, after which the engines are regenerated. Hence, both
+	 * should be called while the simulation is stopped or from a task,
+	 * and the memory for any binary_t's that were loaded is allocated
+	 * with new char[] and owned by you. */
+
+	void save(const std::string& path);
+	void load(const std::string& path);
+
+	/* Incremental checkpoints only contain the 1 MiB chunks of the
+	 * columns that have changed since the last incremental checkpoint,
+	 * along with a manifest of where the rest of them can be found in the
+	 * earlier files, which therefore have to be kept around and not be
+	 * moved. The changes are found by comparing hashes of the chunks, so
+	 * reading the columns is the only cost for the ones that haven't
+	 * changed. The first one, and the first one after a load(), contains
+	 * everything, and so do the columns of booleans and binary_t's every
+	 * time. They're loaded with load() like any other checkpoint. */
+
+	checkpoint_t checkpoints{};
+	void save_incremental(const std::string& path);
+
+	/* This saves a checkpoint without stopping the simulation for it. In
+	 * between two runs through the worksets, the process is forked, and
+	 * the child process writes out the copy of the sandbox it got while
+	 * the parent carries on. The kernel shares the memory between both of
+	 * them, copying pages only as the parent writes to them, so the cost
+	 * to the simulation is a copy of the page tables plus a page fault on
+	 * the first write to each page while the child is still running. */
+
+	/* Columns using the file_memory storage are shared with the child, so
+	 * they're not frozen, and other threads of your own are not copied to
+	 * the child, so make sure they aren't holding any locks the save will
+	 * need (like that of the heap) at the time. If the process can't be
+	 * forked, the checkpoint is saved right away instead. */
+
+	/* snapshot_wait() waits for all of the snapshots to be written, and
+	 * returns false if any of them failed since it was last called. It's
+	 * meant to be called while the simulation is stopped. */
+
+	std::list<std::intmax_t> snapshots{}; // Process ids of the children.
+	bool snapshot_failed = false;
+
+	void snapshot(const std::string& path);
+	bool snapshot_wait();
 };
 
 }
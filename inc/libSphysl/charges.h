@@ -0,0 +1,46 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Library Headerfiles */
+
+#include <libSphysl.h>
+
+/* Avoiding Header Redefinitions */
+
+#ifndef LS_CHARGES_H
+#define LS_CHARGES_H 1
+namespace libSphysl::charges {
+
+/* Function Declarations */
+
+/* This is an engine generator for the electric forces between the entities by
+ * the fast multipole method. It's the same as gravity::multipole(), except
+ * that it goes by the charges of the entities rather than their masses, and
+ * that like charges push each other away. */
+
+std::list<libSphysl::engine_t> multipole(libSphysl::sandbox_t* s);
+
+/* The relevant config values in the sandbox are "entity count" (size_t),
+ * "vacuum permittivity" (double), "opening angle" (double), which must be
+ * more than 0 and at most 1, and "expansion order" (size_t), which must be at
+ * least 1. The generator throws std::invalid_argument otherwise. */
+
+/* The relevant database values in the sandbox are "charge" (double),
+ * "x position" (double), "y position" (double), "z position" (double),
+ * "x force" (double), "y force" (double) and "z force" (double). The vector
+ * quantities can also be packed into vec3_t columns beforehand. */
+
+}
+#endif
@@ -0,0 +1,135 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <memory>
+#include <vector>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl.h>
+
+/* Avoiding Header Redefinitions */
+
+#ifndef LS_COLLISION_H
+#define LS_COLLISION_H 1
+namespace libSphysl::collision {
+
+/* Function Declarations */
+
+/* This is an engine generator for elastic collisions between the entities,
+ * which are treated as boxes that go out from their positions by their
+ * bounding box width, height and depth along each axis. Two entities collide
+ * when their boxes overlap, in which case they're pushed apart until they just
+ * touch, and bounce off each other along each axis as two balls would in one
+ * dimension, with the heavier one pushed the shorter way. An entity that's far
+ * heavier than the rest, then, works as an obstacle that they bounce off
+ * without moving it to speak of. */
+
+/* Rather than testing every pair, every tick the entities are put into a
+ * grid of cells as wide as the biggest box, so that only the entities in
+ * neighbouring cells need to be tested against each other. The cells are
+ * hashed from their coordinates and sorted, so the grid takes no more memory
+ * than the entities themselves, however spread out they are. The collisions
+ * are then worked out in two passes over the columns of cells along x, first
+ * the even ones and then the odd ones, with the columns of each pass split
+ * between the threads. Each column's collisions only involve it and the next
+ * one, so no two threads touch the same entity, and the results don't
+ * depend on the number of threads. */
+
+std::list<libSphysl::engine_t> grid(libSphysl::sandbox_t* s);
+
+/* This is an engine generator for the same collisions, found by sweep and
+ * prune instead. The entities are kept in a list sorted by the lower ends of
+ * their boxes along whichever axis they're most spread out along, and since
+ * they don't move far in a tick, the list is put back in order with an
+ * insertion sort in close to linear time, rather than sorted from scratch.
+ * The threads each sweep through their own part of the list for the boxes that
+ * overlap, and the collisions are then worked out one after another in the
+ * order of the list, so the results don't depend on the number of threads.
+ * This suits entities that are spread out a lot more along one axis than the
+ * others, or that vary a lot in size, where the grid does badly. */
+
+std::list<libSphysl::engine_t> sweep_and_prune(libSphysl::sandbox_t* s);
+
+/* This is a bounding volume hierarchy over the entities' boxes, which can be
+ * kept up to date by the engines from bvh() below. The nodes are stored
+ * depth-first, so the children of a node come right after it, and next is the
+ * index of the first node after its subtree; a node is a leaf if next is the
+ * node right after it, and otherwise its children are at the next index and at
+ * that child's next. Each node's box holds the boxes from first to last, which
+ * are the entities' own boxes, in the order of the tree. */
+
+struct bvh_t {
+	struct box_t {
+		libSphysl::vec3_t min, max;
+		size_t entity;
+	};
+
+	struct node_t {
+		libSphysl::vec3_t min, max;
+		size_t first, last, next;
+	};
+
+	std::vector<box_t> boxes{};
+	std::vector<node_t> nodes{};
+
+	double area = 0.0; // The nodes' surface area when it was built.
+
+	/* This adds the entities whose boxes overlap with the given one to
+	 * found, in the order of the tree. */
+	void query(
+		const libSphysl::vec3_t& min, const libSphysl::vec3_t& max,
+		std::vector<size_t>& found
+	) const;
+};
+
+/* This is an engine generator for the same collisions, found with a bvh_t
+ * instead, which suits scenes where some of the entities are a lot bigger than
+ * the rest, such as large obstacles, since the grid's cells are as wide as the
+ * biggest box, and sweep and prune's list gets them in the way of everything
+ * they span. */
+
+/* Every tick, the boxes are brought up to date and the nodes' boxes are
+ * refitted around them, keeping the shape of the tree as it is, and it's only
+ * built again from scratch once the total surface area of the nodes has grown
+ * by half since it was last built, since the tree gets worse as the entities
+ * move. The tree is built top-down, splitting the boxes where the surface area
+ * heuristic says it's cheapest. The threads then each look up the boxes that
+ * overlap with their own range of boxes, and the collisions are worked out one
+ * after another in the order of the tree, as with sweep_and_prune(). */
+
+/* The tree can be passed in to be kept in your own hands, so that it can also
+ * be queried from the calculators of engines that run after these ones. Its
+ * boxes are where the entities were before they collided that tick, and it's
+ * built again when the engines are regenerated. */
+
+std::list<libSphysl::engine_t> bvh(libSphysl::sandbox_t* s);
+std::list<libSphysl::engine_t> bvh(
+	libSphysl::sandbox_t* s, std::shared_ptr<bvh_t> tree
+);
+
+/* The relevant config values in the sandbox are "entity count" (size_t). */
+
+/* The relevant database values in the sandbox are "mass" (double),
+ * "x position" (double), "y position" (double), "z position" (double),
+ * "x velocity" (double), "y velocity" (double), "z velocity" (double),
+ * "bounding box width" (double), "bounding box height" (double) and
+ * "bounding box depth" (double). The vector quantities can also be packed
+ * into vec3_t columns beforehand. */
+
+}
+#endif
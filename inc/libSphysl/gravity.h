@@ -0,0 +1,130 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Library Headerfiles */
+
+#include <libSphysl.h>
+
+/* Avoiding Header Redefinitions */
+
+#ifndef LS_GRAVITY_H
+#define LS_GRAVITY_H 1
+namespace libSphysl::gravity {
+
+/* Function Declarations */
+
+/* This is an engine generator for Newtonian gravity between every pair of
+ * entities, summed directly. It's exact (as far as doubles go) and takes
+ * O(n^2) time per tick, so it's the reference that the faster, approximate
+ * methods can be checked against, and it's the fastest option anyway for up
+ * to a few tens of thousands of entities. The forces are added to the force
+ * columns, which the motion engines reset every tick. */
+
+/* Each thread works out the total force on its own range of entities, going
+ * through the others in blocks small enough to stay in the L1 cache, a few
+ * entities of its own at a time. Every pair is therefore worked out twice,
+ * once for each entity, but no two threads ever write to the same force, and
+ * the force on each entity is summed in the same order no matter how many
+ * threads there are. Entities at exactly the same position don't attract
+ * each other. */
+
+libSphysl::engine_t classical(libSphysl::sandbox_t* s);
+
+/* The relevant config values in the sandbox are "entity count" (size_t) and
+ * "gravitational constant" (double). */
+
+/* The relevant database values in the sandbox are "mass" (double),
+ * "x position" (double), "y position" (double), "z position" (double),
+ * "x force" (double), "y force" (double) and "z force" (double). The vector
+ * quantities can also be packed into vec3_t columns beforehand. */
+
+/* This is an engine generator for Newtonian gravity by the Barnes-Hut method,
+ * which takes O(n log n) time per tick rather than O(n^2), for when there are
+ * too many entities to sum directly. Every tick, an octree is built around
+ * the entities, and each entity then walks down it, treating any cell that's
+ * far enough away as a single body at its centre of mass. How far is far
+ * enough is set by the opening angle: a cell is opened when its side is more
+ * than the opening angle times its distance from the entity. The smaller the
+ * angle, the more accurate and the slower it is. */
+
+/* The entities are sorted along the Morton curve to build the tree, which is
+ * done in parallel and then merged. Building the tree itself from the sorted
+ * entities takes a single thread, but it's only a small part of the tick, and
+ * the walks are split between all of the threads. As with classical(), no
+ * two threads write to the same force and the forces don't depend on the
+ * number of threads. */
+
+std::list<libSphysl::engine_t> barnes_hut(libSphysl::sandbox_t* s);
+
+/* The relevant config values in the sandbox are the same as classical()'s, as
+ * well as "opening angle" (double), which must be more than 0 and at most 1,
+ * or else the generator throws std::invalid_argument. The relevant database
+ * values are the same as classical()'s too. */
+
+/* This is an engine generator for Newtonian gravity by the fast multipole
+ * method, which takes O(n) time per tick and is more accurate than the
+ * Barnes-Hut method for the same amount of work once there are a lot of
+ * entities. It uses the same octree, but rather than each entity walking it,
+ * every cell gets a multipole expansion of the masses in it, which is turned
+ * into a local expansion of the field around every other cell that's far
+ * enough away from it, and the local expansions are then handed down the tree
+ * to the entities. Two cells are far enough apart when the furthest that
+ * their entities are from their middles, added together, is less than the
+ * opening angle times the distance between those middles.
+ * The expansions are Taylor series in Cartesian coordinates, with terms up to
+ * the expansion order, and the higher the order, the more accurate and the
+ * slower it is. */
+
+/* The tree is split into a few hundred subtrees, whose expansions are worked
+ * out in parallel, and then those of the nodes above them. Each subtree then
+ * works out everything acting on it and hands it down to its entities, again
+ * in parallel. Where the tree is split doesn't depend on the number of
+ * threads, so neither do the forces. The generator throws
+ * std::invalid_argument if the expansion order is 0. */
+
+std::list<libSphysl::engine_t> multipole(libSphysl::sandbox_t* s);
+
+/* The relevant config values in the sandbox are the same as barnes_hut()'s, as
+ * well as "expansion order" (size_t), which is read when the engines are
+ * generated. The relevant database values are the same as classical()'s. */
+
+/* This is an engine generator for Newtonian gravity by the particle-mesh
+ * method, for periodic boxes that are dominated by long-range forces. Every
+ * tick, the masses are spread over a mesh of cells by the cloud-in-cell
+ * scheme, Poisson's equation is solved for the potential on the mesh with
+ * fast Fourier transforms, and the force on each entity is brought back from
+ * the gradient of the potential in the same cells. It takes O(n + M log M)
+ * time per tick for M cells, but forces are smoothed out over a few cells,
+ * so anything that happens on smaller scales needs one of the other methods
+ * as well. The box runs from 0 to the box size along each axis, and entities
+ * outside of it are wrapped back in. */
+
+/* The entities are sorted by the plane of cells they're in, and each thread
+ * spreads the masses onto its own planes, so no two threads write to the same
+ * cell and the forces don't depend on the number of threads. The transforms
+ * are done in the library, a line of cells at a time, with the lines split
+ * between the threads. The generator throws std::invalid_argument if the mesh
+ * size isn't a power of two that's at least 4. */
+
+std::list<libSphysl::engine_t> particle_mesh(libSphysl::sandbox_t* s);
+
+/* The relevant config values in the sandbox are "entity count" (size_t),
+ * "gravitational constant" (double), "box size" (double) and "mesh size"
+ * (size_t), the number of cells along each side, which is read when the
+ * engines are generated. The relevant database values are the same as
+ * classical()'s. */
+
+}
+#endif
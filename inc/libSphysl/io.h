@@ -0,0 +1,165 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl.h>
+
+/* Avoiding Header Redefinitions */
+
+#ifndef LS_IO_H
+#define LS_IO_H 1
+
+/* These are defined in <linux/io_uring.h>, which we don't want to drag into
+ * every file that includes this one. */
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace libSphysl::io {
+
+/* Type Definitions */
+
+/* Buffers are always page-aligned, so that they can be written out directly
+ * when the page cache is being bypassed. */
+typedef std::basic_string<
+	char, std::char_traits<char>, libSphysl::allocator_t<char>
+
+> buffer_t;
+
+/* Structure Declarations */
+
+/* This is the state of an io_uring, see footnote [1]: the submission and
+ * completion queues that we share with the kernel, and the array of
+ * submission queue entries. fd is -1 if there isn't one. */
+
+struct uring_t {
+	int fd = -1;
+
+	void* rings = nullptr;
+	size_t rings_size = 0; // bytes
+
+	io_uring_sqe* sqes = nullptr;
+	size_t sqes_size = 0; // bytes
+
+	unsigned *sq_head{}, *sq_tail{}, *sq_mask{}, *sq_array{};
+	unsigned *cq_head{}, *cq_tail{}, *cq_mask{};
+	io_uring_cqe* cqes = nullptr;
+};
+
+/* This is a write that has been handed over to the kernel, or to the writer's
+ * thread if it's queued. Buffers that were flushed are kept here until they've
+ * been written. */
+
+struct request_t {
+	const char* data;
+	size_t bytes, offset;
+
+	libSphysl::io::buffer_t buffer{};
+	bool busy = false, queued = false;
+};
+
+/* This writes a file from front to back without waiting for the disk. The
+ * data is collected in the buffer, and every time it's flushed, it's handed
+ * over to the kernel with io_uring and replaced with one that's already been
+ * written, so that several writes can be in flight at once and each one
+ * costs a single system call. Where io_uring isn't available, or won't take a
+ * write, it's done with pwrite() on a background thread instead, so that the
+ * simulation doesn't wait for the disk either way. */
+
+/* With direct set, the file is opened with O_DIRECT so that what's written
+ * doesn't fill up the page cache. Only whole pages of the buffer are written
+ * when it's flushed then, and the rest is kept for the next time; the file
+ * is padded out to a whole page at the end and then trimmed back. If the
+ * file system doesn't support O_DIRECT, it's opened normally instead. */
+
+/* The constructor throws std::runtime_error if the file can't be opened.
+ * Once a write fails, the rest of the file is dropped, and finish() throws
+ * std::runtime_error with the reason; the destructor finishes the file too,
+ * but ignores any errors. */
+
+struct writer_t {
+	int fd = -1;
+	std::string path{};
+	bool direct = false;
+
+	libSphysl::io::buffer_t buffer{}; // What hasn't been flushed yet.
+	size_t offset = 0; // Bytes that have been flushed.
+	int error = 0; // The errno of the first write that failed.
+
+	libSphysl::io::uring_t ring{};
+	std::vector<libSphysl::io::request_t> requests{};
+	std::vector<libSphysl::io::buffer_t> spare{};
+
+	/* The thread is only started once it's needed. It takes the indices of
+	 * the requests from the queue, and hands them back with the errno of
+	 * the write, or 0 if it went through. */
+	std::thread thread{};
+	std::mutex lock{};
+	std::condition_variable changed{};
+
+	std::deque<size_t> queue{};
+	std::vector<std::pair<size_t, int>> done{};
+	bool finished = false;
+
+	writer_t(const std::string& path, bool direct = false);
+	~writer_t();
+
+	writer_t(const writer_t&) = delete;
+	writer_t& operator=(const writer_t&) = delete;
+
+	/* This is the size the file will have once everything's written. */
+	size_t size() const { return this -> offset + this -> buffer.size(); }
+
+	/* This flushes the buffer, waiting for an earlier write to finish if
+	 * there are too many in flight. */
+	void flush();
+
+	/* This flushes the buffer and then writes the data as it is, without
+	 * copying it unless the file is direct, so the data has to stay as it
+	 * is until finish() is called. */
+	void write(const char* data, size_t bytes);
+
+	/* This flushes the buffer, waits for everything to be written and
+	 * closes the file. */
+	void finish();
+
+	/* This handles the writes that have finished, waiting for at least
+	 * one of them to if wait is true. */
+	void reap(bool wait);
+
+	/* This hands the request at the index over to the kernel, or to the
+	 * thread if the kernel won't take it. */
+	void submit(size_t index);
+	void kernel();
+};
+
+/* The relevant config value in the sandbox for the writers behind trajectory
+ * files and checkpoints is "direct output" (bool). */
+
+/* [1] J. Axboe, "Efficient IO with io_uring",
+ *     <https://kernel.dk/io_uring.pdf>. */
+
+}
+#endif
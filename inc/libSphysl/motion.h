@@ -46,7 +46,9 @@ libSphysl::engine_t relativistic(libSphysl::sandbox_t* s, size_t smoothing);
  * "x position" (double), "y position" (double), "z position" (double),
  * "x velocity" (double), "y velocity" (double), "z velocity" (double),
  * "x accerelation" (double), "y acceleration" (double), "z acceleration",
- * (double), "x force" (double), "y force" (double), "z force" (double). */
+ * (double), "x force" (double), "y force" (double), "z force" (double). Any
+ * of the vector quantities can also be packed into a single vec3_t column
+ * ("position", "velocity", "acceleration", "force") beforehand. */
 
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,53 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Library Headerfiles */
+
+#include <libSphysl.h>
+
+/* Avoiding Header Redefinitions */
+
+#ifndef LS_ORDERING_H
+#define LS_ORDERING_H 1
+namespace libSphysl::ordering {
+
+/* Function Declarations */
+
+/* These are engine generators for periodically sorting the entities in the
+ * database along a space-filling curve through their positions, so that
+ * entities which are close to each other in space are also close to each
+ * other in memory. This matters a great deal for anything that goes through
+ * the neighbours of each entity, since otherwise every neighbour is a cache
+ * miss. */
+
+/* The Hilbert curve keeps entities together slightly better than the Morton
+ * (Z-order) curve, but its keys are a bit more expensive to compute. Either
+ * way, the reordering is done by sandbox_t::database_reorder() in between two
+ * runs through the worksets, so entities should be looked up with
+ * sandbox_t::entity_row() from then on. */
+
+libSphysl::engine_t morton(libSphysl::sandbox_t* s);
+libSphysl::engine_t hilbert(libSphysl::sandbox_t* s);
+
+/* The relevant config values in the sandbox are "simulation tick" (size_t)
+ * and "reordering interval" (size_t), which must be greater than 0, or else
+ * the generator throws std::invalid_argument. If it's set to 0 afterwards,
+ * the entities aren't reordered any more. */
+
+/* The relevant database values in the sandbox are "x position" (double),
+ * "y position" (double) and "z position" (double). */
+
+}
+#endif
\ No newline at end of file
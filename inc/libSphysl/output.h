@@ -0,0 +1,208 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <atomic>
+#include <fstream>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl.h>
+
+/* Avoiding Header Redefinitions */
+
+#ifndef LS_OUTPUT_H
+#define LS_OUTPUT_H 1
+namespace libSphysl::output {
+
+/* Function Declarations */
+
+/* This is an engine generator for writing the trajectories of the entities to
+ * a file. Every so many ticks, the given columns are copied as they are into
+ * a frame at the end of a large buffer, and full buffers are handed over to
+ * the kernel to be written to the file (see io::writer_t), so that the
+ * simulation never has to wait for the disk unless it falls behind by
+ * several buffers.
+ * The columns can be of any type but binary_t, and aliases of packed axes
+ * (see sandbox_t::database_pack()) can be used too. */
+
+/* The generator throws std::runtime_error if the file can't be opened, and
+ * std::invalid_argument if one of the columns is of binary_t's. If it
+ * can't be written to later on, the rest of the trajectory is dropped. The
+ * file is finished when the engine is destroyed along with the sandbox. */
+
+libSphysl::engine_t trajectory(
+	libSphysl::sandbox_t* s, const std::string& path,
+	const std::list<std::string>& columns
+);
+
+/* The files are laid out as follows, with every integer being a uint64_t and
+ * every string being its length followed by its characters:
+ *
+ *     magic number ("SphyslTR"), format version (1),
+ *     columns (count, then the id and type of each),
+ *     frames (size, tick, time, entity count, then the data of each column).
+ *
+ * The type is the index of the alternative in the data_vector_t, the size is
+ * that of the whole frame in bytes, so frames can be skipped over without
+ * reading them, and the time is a double. The data of each column is all of
+ * its values as they are in memory, except for booleans, which are a byte
+ * each. All of the values are native-endian. */
+
+/* The relevant config values in the sandbox are "simulation tick" (size_t),
+ * "time" (double), "entity count" (size_t), "output interval" (size_t),
+ * which must be greater than 0, and "direct output" (bool). The generator
+ * throws std::invalid_argument if the interval is 0, and if it's set to 0
+ * afterwards, nothing more is written. */
+
+/* This is an engine generator for writing compressed trajectories of columns
+ * of doubles (or aliases of packed axes) to a file, usually several times
+ * smaller than the ones written by trajectory(). Each column is given with
+ * the largest error that can be tolerated in its values, which are rounded
+ * to the nearest multiple of twice that, turned into the difference from the
+ * previous frame, and packed into as few bits as the largest difference in
+ * each block of 64 entities needs. So the smoother the motion, the smaller
+ * the file. The columns are encoded in parallel, and written out the same
+ * way as in trajectory(). */
+
+/* Every so many frames, and whenever the number of entities changes, the
+ * columns are encoded as they are rather than as differences, so that a
+ * decoder can start from there. Values which don't fit into 62 bits after
+ * rounding are clamped, and NaN's are written as 0. */
+
+/* The generator throws std::runtime_error if the file can't be opened, and
+ * std::invalid_argument if one of the columns doesn't hold doubles or has a
+ * tolerance that isn't greater than 0. */
+
+std::list<libSphysl::engine_t> compressed(
+	libSphysl::sandbox_t* s, const std::string& path,
+	const std::map<std::string, double>& columns
+);
+
+/* The files are laid out like the ones written by trajectory(), except that
+ * the magic number is "SphyslTZ", the tolerance (double) is stored instead of
+ * the type of each column, and the data of each column is preceded by its
+ * size. The data starts with a byte that is 1 if the frame is a keyframe and
+ * 0 otherwise, followed by each block of 64 entities as a byte with the width
+ * of the values in bits and the zigzag-encoded values (see footnote [1]), with
+ * the least significant bit first. */
+
+/* The relevant config values in the sandbox are the same as trajectory()'s,
+ * as well as "keyframe interval" (size_t), which must be greater than 0 too,
+ * or else the generator throws std::invalid_argument. If it's set to 0
+ * afterwards, every frame is a keyframe. */
+
+/* This reads back the files written by compressed() one frame at a time, so
+ * that they don't need to fit in memory. The decoder throws std::runtime_error
+ * if the file can't be opened or isn't one of ours, and next() returns false
+ * at the end of the file. Each column will have the values rounded as they
+ * were described above. */
+
+struct frame_t {
+	size_t tick{}, count{};
+	double time{};
+
+	std::map<std::string, std::vector<double>> columns{};
+};
+
+struct decoder_t {
+	std::ifstream file;
+	std::vector<std::pair<std::string, double>> columns{};
+
+	/* The rounded values from the previous frame. */
+	std::map<std::string, std::vector<std::int64_t>> previous{};
+	std::string buffer{};
+
+	decoder_t(const std::string& path);
+	bool next(libSphysl::output::frame_t& frame);
+};
+
+/* This is an engine generator for showing the simulation to viewers running
+ * in other processes. Every so many ticks, the given columns of doubles (or
+ * aliases of packed axes) are copied into the next slot of a ring buffer in
+ * POSIX shared memory with the given name (which should start with a '/'),
+ * and the viewers can read the latest frame whenever they like without the
+ * simulation ever waiting on them. The shared memory is removed when the
+ * engine is destroyed, and the generator throws std::runtime_error if it
+ * can't be created, or std::invalid_argument if a column doesn't hold
+ * doubles. */
+
+/* The ring has room for as many entities as there were when it was created;
+ * if there are more later on, the rest are left out. */
+
+libSphysl::engine_t ring(
+	libSphysl::sandbox_t* s, const std::string& name,
+	const std::list<std::string>& columns
+);
+
+/* The shared memory starts with a ring_t, followed by the ids of the columns
+ * as null-terminated strings. The slots come after that, each of them 4 KiB
+ * aligned and starting with a slot_t, followed by the values of each column
+ * in turn, with room for capacity values each. */
+
+/* The slots are written like seqlocks: the sequence number of a slot is odd
+ * while it's being written, and goes up by two every time, so a viewer can
+ * copy a frame out and then check that the sequence number hasn't changed
+ * in the meantime, trying again if it did. The latest frame is in the slot
+ * given by latest % slots, and it's 0 until the first one is written. */
+
+struct ring_t {
+	uint64_t magic; // "SphyslRB"
+	uint64_t format; // 1
+
+	uint64_t slots, capacity, columns;
+	uint64_t offset, slot_size; // bytes to the first slot, size of each
+
+	std::atomic<uint64_t> latest; // Number of frames written.
+};
+
+struct slot_t {
+	std::atomic<uint64_t> sequence;
+
+	uint64_t tick, count;
+	double time;
+};
+
+/* This is how you read the frames in a viewer. It throws std::runtime_error
+ * if the shared memory can't be opened or isn't one of ours. read() returns
+ * false if there hasn't been a new frame since the last one it read. */
+
+struct viewer_t {
+	const char* data{}; // The mapped shared memory.
+	size_t size{}; // bytes
+
+	std::vector<std::string> columns{};
+	uint64_t last = 0; // The last frame that was read.
+
+	viewer_t(const std::string& name);
+	~viewer_t();
+
+	viewer_t(const viewer_t&) = delete;
+	viewer_t& operator=(const viewer_t&) = delete;
+
+	bool read(libSphysl::output::frame_t& frame);
+};
+
+/* The relevant config values in the sandbox are "simulation tick" (size_t),
+ * "time" (double), "entity count" (size_t) and "viewer interval" (size_t),
+ * which must be greater than 0, or else the generator throws
+ * std::invalid_argument. If it's set to 0 afterwards, nothing more is
+ * published. */
+
+/* [1] <https://developers.google.com/protocol-buffers/docs/encoding> */
+
+}
+#endif
@@ -0,0 +1,81 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <functional>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl.h>
+
+/* Avoiding Header Redefinitions */
+
+#ifndef LS_POTENTIALS_H
+#define LS_POTENTIALS_H 1
+namespace libSphysl::potentials {
+
+/* Type Definitions */
+
+/* This gives the size of the force between two entities at a distance r from
+ * each other, which is positive if they push each other away. */
+typedef std::function<double(double r)> force_t;
+
+/* Function Declarations */
+
+/* This is an engine generator for the Lennard-Jones potential between every
+ * pair of entities within the cutoff of each other, which is the usual model
+ * of how neutral atoms and molecules interact,
+ *
+ * V(r) = 4 epsilon ((sigma / r)^12 - (sigma / r)^6),
+ *
+ * so that they push each other away when they're closer than 2^(1/6) sigma
+ * and pull each other in when they're further apart. The potential is simply
+ * cut off, and entities at exactly the same position are left alone. */
+
+/* The pairs come from a Verlet list of neighbours (see update_neighbours() in
+ * utility.h), whose skin is the cutoff times the "neighbour skin", so that
+ * each tick takes linear time. The pairs are split into the force partitions
+ * by their first entities, and each pair's force is added onto both of them,
+ * as by Newton's third law, which makes each pair cost half as much, and the
+ * forces come out the same no matter how many threads there are, unless
+ * there's one partition per thread (see forces_t in utility.h). They're then
+ * added to the force columns, which the motion engines reset every tick. */
+
+std::list<libSphysl::engine_t> lennard_jones(libSphysl::sandbox_t* s);
+
+/* The relevant config values in the sandbox are "entity count" (size_t),
+ * "force partitions" (size_t), "lennard-jones epsilon" (double),
+ * "lennard-jones sigma" (double), "lennard-jones cutoff" (double) and
+ * "neighbour skin" (double). The cutoff and the skin only take effect when
+ * the engines are generated. */
+
+/* The relevant database values in the sandbox are "x position" (double),
+ * "y position" (double), "z position" (double), "x force" (double),
+ * "y force" (double) and "z force" (double). The vector quantities can also
+ * be packed into vec3_t columns beforehand. */
+
+/* This is the same for any other force that's cut off beyond some distance,
+ * given as a force_t, which is called once for every pair within the cutoff
+ * every tick, so it's slower than lennard_jones(). It throws
+ * std::invalid_argument unless the cutoff is positive. The relevant config
+ * and database values are the same, save for the Lennard-Jones ones. */
+
+std::list<libSphysl::engine_t> pairwise(
+	libSphysl::sandbox_t* s, const force_t& force, double cutoff
+);
+
+}
+#endif
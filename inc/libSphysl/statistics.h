@@ -0,0 +1,48 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Library Headerfiles */
+
+#include <libSphysl.h>
+
+/* Avoiding Header Redefinitions */
+
+#ifndef LS_STATISTICS_H
+#define LS_STATISTICS_H 1
+namespace libSphysl::statistics {
+
+/* Function Declarations */
+
+/* This is an engine generator for keeping statistics about columns of doubles
+ * (or aliases of packed axes) up to date every tick, for monitoring a running
+ * simulation. The minimum, maximum, sum and mean of each column are written to
+ * the config values "<id> minimum", "<id> maximum", "<id> sum" and "<id> mean"
+ * (double), which are created if they don't exist. */
+
+/* The entities are split into blocks of a fixed size which are reduced in
+ * parallel, and the results for the blocks are then combined pairwise in a
+ * fixed order, so the sums come out the same no matter how many threads are
+ * being used. With no entities, the minimum and maximum are infinite and the
+ * mean is NaN. The generator throws std::invalid_argument if a column doesn't
+ * hold doubles. */
+
+std::list<libSphysl::engine_t> reductions(
+	libSphysl::sandbox_t* s, const std::list<std::string>& columns
+);
+
+/* The relevant config value in the sandbox is "entity count" (size_t). */
+
+}
+#endif
@@ -15,6 +15,7 @@
 
 /* Including Standard Libraries */
 
+#include <memory>
 #include <random>
 
 /* Including Library Headerfiles */
@@ -88,54 +89,70 @@ struct vector_t {
  *        value1.goto_begin();
  *        std::cout << value1(); // 2.0 */
 
+/* Slices can also be strided, in which case consecutive values are <stride>
+ * elements apart in memory. This is how a single axis of a packed column of
+ * vec3_t's is sliced (see get_axis() below). Note that the range-based syntax
+ * only works for slices with a stride of 1, since begin() and end() return
+ * plain pointers. */
+
 template<typename T> struct slice_t {
-	std::vector<T>& vector; // Vector we are slicing.
+	T *base; // Beginning of the memory we are slicing.
 	T *start, *stop, *data; // Start and stop iterators, current iterator.
+	size_t stride; // Distance between consecutive values.
 
 	slice_t() {}; // Don't do anything if we haven't been given anything.
 
 	slice_t(const slice_t& slice):
 		/* Initialise variables. */
-		vector{slice.vector}, start{slice.start}, stop{slice.stop},
-		data{slice.data}
+		base{slice.base}, start{slice.start}, stop{slice.stop},
+		data{slice.data}, stride{slice.stride}
 	{}
 
-	slice_t(std::vector<T>& vector):
+	template<typename A> slice_t(std::vector<T, A>& vector):
 		/* Initialise variables. */
-		vector{vector},
+		base{vector.data()},
 
 		/* Set the start and stop iterators to the vector's. Set the
 		 * current iterator to the start. */
-		start{vector.begin()}, stop{vector.end()}, data{vector.begin()}
+		start{base}, stop{base + vector.size()}, data{base}, stride{1}
 	{}
 
-	slice_t(std::vector<T>& vector, size_t start, size_t stop):
+	template<typename A>
+	slice_t(std::vector<T, A>& vector, size_t start, size_t stop):
 		/* Initialise the variables, set the current iterator to the
 		 * start. */
-		vector{vector}, start{&vector[start]}, stop{&vector[stop]},
-		data{&vector[start]}
+		base{vector.data()}, start{base + start}, stop{base + stop},
+		data{base + start}, stride{1}
+	{}
+
+	slice_t(T* base, size_t stride, size_t start, size_t stop):
+		/* Initialise the variables for a strided slice, set the
+		 * current iterator to the start. */
+		base{base}, start{base + start * stride},
+		stop{base + stop * stride}, data{base + start * stride},
+		stride{stride}
 	{}
 
 	/* Advance the iterator or move backwards. */
-	slice_t& operator++() {this -> data++; return *this;}
-	slice_t& operator--() {this -> data--; return *this;}
+	slice_t& operator++() {this -> data += stride; return *this;}
+	slice_t& operator--() {this -> data -= stride; return *this;}
 
 	/* Advancing or moving back the iterator but for postfix-notation. */
 	slice_t operator++(int) {
 		slice_t slice(*this); // Save the current state of the object.
-		this -> data++; // Move the iterator forwards.
+		this -> data += stride; // Move the iterator forwards.
 		return slice; // Return the saved state.
 	}
 
 	slice_t operator--(int) {
 		slice_t slice(*this); // Save state.
-		this -> data--; // Move backwards.
+		this -> data -= stride; // Move backwards.
 		return slice; // Return saved state.
 	}
 
 	/* Set the ends of the slice */
-	void set_begin(size_t ind) {this -> start = &(this -> vector[ind]);}
-	void set_end  (size_t ind) {this -> stop  = &(this -> vector[ind]);}
+	void set_begin(size_t ind) {this -> start = base + ind * stride;}
+	void set_end  (size_t ind) {this -> stop  = base + ind * stride;}
 
 	/* Move to the ends of the slice. */
 	void goto_begin() {this -> data = this -> start;}
@@ -145,6 +162,9 @@ template<typename T> struct slice_t {
 	T* begin() const{return this -> start;}
 	T* end  () const{return this -> stop; }
 
+	/* Get the value at an index relative to the start of the slice. */
+	T& operator[](size_t ind) const{return start[ind * stride];}
+
 	/* Get the value or a negated version of it. */
 	T& operator()() const{return  *(this -> data);}
 	T  operator- () const{return -*(this -> data);}
@@ -206,6 +226,15 @@ template<typename T> struct slice_t {
 
 /* Function Declarations */
 
+/* This returns a slice of one axis of a vector quantity, e.g. "x position",
+ * from start to stop. It works the same whether the axis is stored as its own
+ * column or has been packed into a column of vec3_t's with
+ * sandbox_t::database_pack(), in which case the slice is strided. */
+slice_t<double> get_axis(
+	libSphysl::sandbox_t* s, const std::string& id,
+	size_t start, size_t stop
+);
+
 /* Simple templated function to de-allocate heap-allocated arguments given
  * their type. The understanding is that this will be used by most engine
  * generators unless they're doing something specific unto themselves. */
@@ -241,12 +270,19 @@ double random(const double min, const double max);
 
 /* Same as random() but fill a vector with the random values. */
 
-template<typename T>
-void randomise(std::vector<T>& v, const T min, const T max) {
+template<typename T, typename A>
+void randomise(std::vector<T, A>& v, const T min, const T max) {
 	std::random_device device; // Random data generator.
 	std::mt19937 engine{device()}; // Random number generator.
-	std::uniform_int_distribution<T> distribution(min, max);
-	// Distribution generator.
+
+	/* Doubles use a different distribution generator from the integers
+	 * for the same reason as above. */
+	typedef std::conditional_t<std::is_floating_point_v<T>,
+		std::uniform_real_distribution<T>,
+		std::uniform_int_distribution<T>
+	> distribution_t;
+
+	distribution_t distribution(min, max); // Distribution generator.
 
 	/* Loop over the vector and set all the values to random ones. */
 	for(auto &i: v) {
@@ -254,9 +290,6 @@ void randomise(std::vector<T>& v, const T min, const T max) {
 	}
 }
 
-/* Overload for doubles for the same reason. */
-void randomise(std::vector<double>& v, const double min, const double max);
-
 /* The following functions are implemented as they are almost universally
  * needed by engine generators for distributing their computations across
  * threads. */
@@ -267,6 +300,92 @@ std::vector<std::pair<size_t, size_t>> divide_range(
 	const size_t start, const size_t stop, const size_t divisions
 );
 
+/* Pair-force engines add the force between each pair of entities onto both of
+ * them, so two threads can't be allowed to work on pairs which share an entity
+ * at the same time, and the order in which the forces are added up changes the
+ * last few bits of the result. Hence, such engines split their pairs into a
+ * fixed number of partitions ("force partitions" in the config), rather than
+ * one per thread, and each partition adds its forces onto its own copy of the
+ * forces. The copies are then added onto "x/y/z force" in order by the engine
+ * from reduce_forces(), which runs in parallel over the entities. As long as
+ * the pairs are always split up and gone through the same way, the forces come
+ * out the same bit-for-bit no matter how many threads there are. */
+
+/* The copies take up a fair bit of memory with a lot of entities, and with
+ * more partitions than threads, each thread goes through more than one of
+ * them. If "force partitions" is 0, then, there's one for each thread of the
+ * sandbox instead, so that each thread adds its forces onto its own copy and
+ * they're all added up in one go afterwards, but the forces then change in
+ * the last few bits with the number of threads. */
+
+struct forces_t {
+	size_t count, partitions; // Number of entities, copies.
+
+	/* The copies, one after the other, which are zeroed again once
+	 * they've been added up. */
+	libSphysl::column_t<libSphysl::vec3_t> values;
+
+	libSphysl::vec3_t* partition(size_t i) {
+		return this -> values.data() + i * this -> count;
+	}
+};
+
+/* This makes a zeroed forces_t for the current entities with the sandbox's
+ * storage. It's shared between the engines that use it, so that it's freed
+ * along with whichever of them is destroyed last. */
+std::shared_ptr<forces_t> make_forces(libSphysl::sandbox_t* s);
+
+libSphysl::engine_t reduce_forces(
+	libSphysl::sandbox_t* s, const std::shared_ptr<forces_t>& forces
+);
+
+/* The relevant config values in the sandbox are "entity count" (size_t) and
+ * "force partitions" (size_t), and the relevant database values are "x force"
+ * (double), "y force" (double) and "z force" (double), which can be packed
+ * ("force"). */
+
+/* Short-range pair engines only need the pairs of entities that are within
+ * some cutoff of each other, and finding those every tick would cost as much
+ * as the forces themselves. Hence, they can keep a Verlet list instead, which
+ * holds the pairs within the cutoff plus a skin, and which only needs to be
+ * built again once some entity has moved more than half of the skin since it
+ * was last built, since no pair can have come within the cutoff from outside
+ * of the list before then. */
+
+/* The list is stored in compressed sparse rows: the neighbours of entity i
+ * are the ones in indices from offsets[i] up to offsets[i + 1], in ascending
+ * order, and only the ones after it are listed, so each pair is there just
+ * once. builds is the number of times the list has been built, which is
+ * handy for picking a skin. */
+
+struct neighbours_t {
+	size_t count; // Number of entities.
+	double cutoff, skin; // metres
+
+	std::vector<size_t> offsets, indices;
+	size_t builds;
+};
+
+/* This makes an empty neighbours_t for the current entities, and it throws
+ * std::invalid_argument unless the cutoff is positive and the skin isn't
+ * negative. The list is built by the engines from update_neighbours(), which
+ * should run before the ones that use it every tick, and be regenerated along
+ * with them. The entities are sorted into a grid of cells as wide as the
+ * cutoff plus the skin, so that each of them is only compared with those in
+ * the cells around it, and the lists are built in parallel, coming out the
+ * same no matter how many threads there are. */
+std::shared_ptr<neighbours_t> make_neighbours(
+	libSphysl::sandbox_t* s, double cutoff, double skin
+);
+
+std::list<libSphysl::engine_t> update_neighbours(
+	libSphysl::sandbox_t* s, const std::shared_ptr<neighbours_t>& neighbours
+);
+
+/* The relevant config value in the sandbox is "entity count" (size_t), and
+ * the relevant database values are "x position" (double), "y position"
+ * (double) and "z position" (double), which can be packed ("position"). */
+
 /* Type definitions for callback functions. */
 typedef std::function<void(std::vector<size_t> combination)> on_combination_t;
 typedef std::function<void()> on_exclusivity_end_t;
@@ -0,0 +1,785 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+/* Including System Headerfiles */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl.h>
+#include <libSphysl/io.h>
+
+/* The checkpoint files are laid out as follows, with every integer being a
+ * uint64_t and every string being its length followed by its characters:
+ *
+ *     magic number, format version,
+ *     files (count, then the path of each),
+ *     config (count, then the id, type and value of each entry),
+ *     uniforms (same as the config),
+ *     axes (count, then the alias, packed column and axis of each),
+ *     rows (count, then the values),
+ *     columns (count, then the id, type and size of each, and its data).
+ *
+ * The type is the index of the alternative in the data_t or data_vector_t,
+ * and binary_t values are their length followed by their bytes. The data of
+ * each column comes right after its entry, padded to the next 4 KiB. */
+
+/* Columns of booleans are stored a byte per value, and columns of binary_t's
+ * as the lengths of all the values followed by all of their bytes. The rest
+ * are stored as is, in chunks of 1 MiB, and their entries are followed by the
+ * number of chunks, and the file and offset of each. File 0 is the file being
+ * read, and the others are the files listed at the start of it, so that
+ * incremental checkpoints can refer to the chunks in earlier ones. */
+
+/* Version 1 of the format didn't have the list of files or the chunks, so its
+ * columns were stored in one piece right after their entries. */
+
+/* Structure Declarations */
+
+namespace {
+
+/* This maps a whole file into memory for reading. */
+struct mapping_t {
+	const char* data{};
+	size_t size{}; // bytes
+
+	mapping_t(const std::string& path);
+	~mapping_t();
+
+	mapping_t(const mapping_t&) = delete;
+	mapping_t& operator=(const mapping_t&) = delete;
+};
+
+/* This keeps track of where we are in a file we're reading. */
+struct reader_t {
+	const mapping_t& file;
+	size_t offset; // bytes
+
+	uint64_t format; // Version of the format being read.
+	std::vector<std::string> files; // Files the chunks can be in.
+	std::map<size_t, std::unique_ptr<mapping_t>> mappings;
+
+	const char* take(size_t bytes);
+	template<typename T> T get();
+
+	/* This returns the data of a chunk in whichever file it's in. */
+	const char* chunk(size_t file, size_t offset, size_t bytes);
+};
+
+/* This keeps track of the file we're writing. Everything that isn't the data
+ * in a column is collected in its buffer and written out along with the
+ * padding before the next column's data. */
+struct writer_t {
+	libSphysl::io::writer_t file;
+
+	/* For incremental checkpoints, these are the chunks written to the
+	 * earlier files, and the ones that this file will have. */
+	const libSphysl::checkpoint_t* earlier;
+	std::map<std::string, std::vector<libSphysl::chunk_t>> chunks;
+
+	void pad();
+};
+
+}
+
+/* Constants Declarations */
+
+static const uint64_t magic = 0x50436c7379687053; // "SphyslCP"
+static const uint64_t format = 2;
+
+static const size_t alignment = 4096; // bytes
+static const size_t chunk_size = size_t{1} << 20;
+
+/* Function Declarations */
+
+/* This does the work for both save() and save_incremental(). */
+static void write_checkpoint(
+	libSphysl::sandbox_t* s, const std::string& path,
+	const libSphysl::checkpoint_t* earlier,
+	std::map<std::string, std::vector<libSphysl::chunk_t>>* chunks
+);
+
+/* These append values to the buffer of metadata that is going to be written
+ * out before the next column. */
+template<typename T> static void put(
+	libSphysl::io::buffer_t& buffer, const T& value
+);
+
+static void put(libSphysl::io::buffer_t& buffer, const std::string& value);
+
+static void put(
+	libSphysl::io::buffer_t& buffer, const libSphysl::data_t& value
+);
+
+static void put(
+	libSphysl::io::buffer_t& buffer, const libSphysl::config_t& config
+);
+
+/* These read back what the above wrote. */
+static std::string get_string(reader_t& reader);
+static libSphysl::data_t get_value(reader_t& reader);
+static void get_config(reader_t& reader, libSphysl::config_t& config);
+
+/* These write out and read back the data of a column. */
+static void write_column(
+	writer_t& writer, const std::string& id,
+	const libSphysl::data_vector_t& column
+);
+
+static void write_chunks(
+	writer_t& writer, const std::string& id, size_t type,
+	const char* data, size_t bytes
+);
+
+static libSphysl::data_vector_t read_column(
+	reader_t& reader, size_t type, size_t size,
+	const libSphysl::storage_t& storage
+);
+
+static void read_chunks(reader_t& reader, char* data, size_t bytes);
+
+/* This hashes the contents of a chunk, see footnote [1]. */
+static uint64_t hash(const char* data, size_t bytes, uint64_t seed);
+
+/* This reaps the snapshot processes that have finished, or waits for all of
+ * them to finish if wait is true, noting whether any of them failed. */
+static void reap(libSphysl::sandbox_t* s, bool wait);
+
+/* This throws a std::runtime_error with the message and the error number. */
+[[noreturn]] static void fail(const std::string& message);
+
+/* Function Definitions */
+
+void libSphysl::sandbox_t::save(const std::string& path) {
+	write_checkpoint(this, path, nullptr, nullptr);
+}
+
+void libSphysl::sandbox_t::save_incremental(const std::string& path) {
+	/* Only remember the new chunks once they've been written out. */
+	std::map<std::string, std::vector<libSphysl::chunk_t>> chunks;
+	write_checkpoint(this, path, &this -> checkpoints, &chunks);
+
+	this -> checkpoints.files.push_back(path);
+	this -> checkpoints.chunks = std::move(chunks);
+}
+
+static void write_checkpoint(
+	libSphysl::sandbox_t* s, const std::string& path,
+	const libSphysl::checkpoint_t* earlier,
+	std::map<std::string, std::vector<libSphysl::chunk_t>>* chunks
+){
+	const auto direct = std::get<bool>(s -> config_get("direct output"));
+	writer_t writer{{path, direct}, earlier, {}};
+	auto& buffer = writer.file.buffer;
+
+	put(buffer, magic);
+	put(buffer, format);
+
+	/* Full checkpoints don't refer to any other files. */
+	const auto files = earlier? earlier -> files.size(): 0;
+	put(buffer, uint64_t{files});
+
+	for(size_t i = 0; i < files; i++) {
+		put(buffer, earlier -> files[i]);
+	}
+
+	put(buffer, s -> config);
+	put(buffer, s -> uniforms);
+
+	put(buffer, uint64_t{s -> axes.size()});
+	for(const auto& [alias, axis]: s -> axes) {
+		put(buffer, alias);
+		put(buffer, axis.first);
+		put(buffer, uint64_t{axis.second});
+	}
+
+	put(buffer, uint64_t{s -> rows.size()});
+	for(const auto& i: s -> rows) {
+		put(buffer, uint64_t{i});
+	}
+
+	put(buffer, uint64_t{s -> database.size()});
+
+	/* If anything goes wrong, the file's closed by the writer's
+	 * destructor. */
+	for(const auto& [id, column]: s -> database) {
+		write_column(writer, id, column);
+	}
+
+	writer.file.finish();
+	if(chunks) *chunks = std::move(writer.chunks);
+}
+
+void libSphysl::sandbox_t::load(const std::string& path) {
+	const mapping_t file(path);
+	reader_t reader{file, 0, 0, {}, {}};
+
+	/* Read everything into temporaries first, so that the sandbox is left
+	 * as it was if the file turns out to be broken. */
+	libSphysl::config_t config, uniforms;
+	decltype(this -> axes) axes;
+	decltype(this -> rows) rows;
+	libSphysl::database_t database;
+
+	if(reader.get<uint64_t>() != magic) throw std::runtime_error(
+		"'" + path + "' isn't a libSphysl checkpoint"
+	);
+
+	reader.format = reader.get<uint64_t>();
+	if(!reader.format || reader.format > format) throw std::runtime_error(
+		"'" + path + "' has an unsupported format version"
+	);
+
+	if(reader.format > 1) {
+		reader.files.resize(reader.get<uint64_t>());
+		for(auto& i: reader.files) i = get_string(reader);
+	}
+
+	get_config(reader, config);
+	get_config(reader, uniforms);
+
+	for(auto i = reader.get<uint64_t>(); i; i--) {
+		const auto alias = get_string(reader);
+		const auto packed = get_string(reader);
+		axes[alias] = {packed, reader.get<uint64_t>()};
+	}
+
+	rows.resize(reader.get<uint64_t>());
+	for(auto& i: rows) {
+		i = reader.get<uint64_t>();
+	}
+
+	for(auto i = reader.get<uint64_t>(); i; i--) {
+		const auto id = get_string(reader);
+		const auto type = reader.get<uint64_t>();
+		const auto size = reader.get<uint64_t>();
+
+		database[id] = read_column(reader, type, size, this -> storage);
+	}
+
+	/* Engines may be holding references to the config values, so those
+	 * are overwritten in place rather than replaced. */
+	for(auto& [id, value]: config) {
+		this -> config[id] = std::move(value);
+	}
+
+	this -> uniforms = std::move(uniforms);
+	this -> axes = std::move(axes);
+	this -> rows = std::move(rows);
+	this -> database = std::move(database);
+
+	/* None of the columns came from the incremental checkpoints we've
+	 * saved, so the next one has to start over. */
+	this -> checkpoints = {};
+
+	/* The engines' arguments are pointing into the old columns. */
+	this -> regenerate();
+}
+
+void libSphysl::sandbox_t::snapshot(const std::string& path) {
+	this -> schedule([path](libSphysl::sandbox_t* s) {
+		/* Clean up after the earlier snapshots, if they're done. */
+		reap(s, false);
+
+		const auto pid = fork();
+
+		/* If we can't fork, we have to do it the slow way. */
+		if(pid == -1) {
+			try {
+				s -> save(path);
+			}
+
+			catch(...) {
+				s -> snapshot_failed = true;
+			}
+
+			return;
+		}
+
+		/* The child saves its copy of the sandbox and leaves without
+		 * running any destructors, since the parent owns everything
+		 * and the other threads don't exist over here anyway. */
+		if(pid == 0) {
+			int status = 0;
+
+			try {
+				s -> save(path);
+			}
+
+			catch(...) {
+				status = 1;
+			}
+
+			_exit(status);
+		}
+
+		s -> snapshots.push_back(pid);
+	});
+}
+
+bool libSphysl::sandbox_t::snapshot_wait() {
+	reap(this, true);
+
+	const auto ret = !this -> snapshot_failed;
+	this -> snapshot_failed = false;
+	return ret;
+}
+
+static void reap(libSphysl::sandbox_t* s, bool wait) {
+	auto i = s -> snapshots.begin();
+
+	while(i != s -> snapshots.end()) {
+		int status;
+		const auto ret = waitpid(*i, &status, wait? 0: WNOHANG);
+
+		if(ret == -1 && errno == EINTR) continue;
+		if(ret == 0) {
+			i++; continue; // Still running.
+		}
+
+		/* If we can't wait for it, it's not ours to wait for. */
+		if(ret == -1 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+			s -> snapshot_failed = true;
+		}
+
+		i = s -> snapshots.erase(i);
+	}
+}
+
+mapping_t::mapping_t(const std::string& path) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if(fd == -1) fail("couldn't open '" + path + "' for reading");
+
+	struct stat info;
+	if(fstat(fd, &info) == -1) {
+		close(fd); fail("couldn't stat '" + path + "'");
+	}
+
+	/* An empty file can't be mapped, but it isn't a checkpoint either. */
+	this -> size = info.st_size;
+	if(!this -> size) {
+		close(fd); throw std::runtime_error(
+			"'" + path + "' isn't a libSphysl checkpoint"
+		);
+	}
+
+	/* Map the whole file, since we're going to read all of it in order. */
+	const auto data = mmap(
+		nullptr, this -> size, PROT_READ, MAP_PRIVATE, fd, 0
+	);
+
+	close(fd);
+	if(data == MAP_FAILED) fail("couldn't map '" + path + "'");
+
+	madvise(data, this -> size, MADV_SEQUENTIAL);
+	this -> data = static_cast<const char*>(data);
+}
+
+mapping_t::~mapping_t() {
+	munmap(const_cast<char*>(this -> data), this -> size);
+}
+
+const char* reader_t::take(size_t bytes) {
+	const auto ret = this -> chunk(0, this -> offset, bytes);
+	this -> offset += bytes;
+	return ret;
+}
+
+template<typename T> T reader_t::get() {
+	/* The values aren't necessarily aligned, so they're copied out. */
+	T value;
+	std::memcpy(&value, this -> take(sizeof(T)), sizeof(T));
+	return value;
+}
+
+const char* reader_t::chunk(size_t file, size_t offset, size_t bytes) {
+	/* Map the earlier files as we need them. */
+	const mapping_t* mapping = &this -> file;
+
+	if(file) {
+		if(file > this -> files.size()) throw std::runtime_error(
+			"checkpoint file refers to an unknown file"
+		);
+
+		auto& i = this -> mappings[file];
+		if(!i) i = std::make_unique<mapping_t>(this -> files[file - 1]);
+		mapping = i.get();
+	}
+
+	if(offset > mapping -> size || bytes > mapping -> size - offset) {
+		throw std::runtime_error("checkpoint file is truncated");
+	}
+
+	return mapping -> data + offset;
+}
+
+void writer_t::pad() {
+	const auto end = this -> file.size();
+	this -> file.buffer.append(
+		(alignment - end % alignment) % alignment, '\0'
+	);
+}
+
+template<typename T> static void put(
+	libSphysl::io::buffer_t& buffer, const T& value
+){
+	buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void put(libSphysl::io::buffer_t& buffer, const std::string& value) {
+	put(buffer, uint64_t{value.size()});
+	buffer.append(value.data(), value.size());
+}
+
+static void put(
+	libSphysl::io::buffer_t& buffer, const libSphysl::data_t& value
+){
+	put(buffer, uint64_t{value.index()});
+
+	std::visit([&](const auto& v) {
+		typedef std::decay_t<decltype(v)> T;
+
+		if constexpr(std::is_same_v<T, libSphysl::binary_t>) {
+			const auto bytes = static_cast<const char*>(v.value);
+			put(buffer, uint64_t{v.length});
+			buffer.append(bytes, v.length);
+		}
+
+		else put(buffer, v);
+	}, value);
+}
+
+static void put(
+	libSphysl::io::buffer_t& buffer, const libSphysl::config_t& config
+){
+	put(buffer, uint64_t{config.size()});
+
+	for(const auto& [id, value]: config) {
+		put(buffer, id);
+		put(buffer, value);
+	}
+}
+
+static std::string get_string(reader_t& reader) {
+	const auto size = reader.get<uint64_t>();
+	return std::string(reader.take(size), size);
+}
+
+/* This sets value to the alternative with the given index of the variant, so
+ * that we can go from the type in the file back to a type in C++. */
+template<typename V, size_t i = 0>
+static void emplace(V& value, size_t index) {
+	if constexpr(i < std::variant_size_v<V>) {
+		if(index == i) value.template emplace<i>();
+		else emplace<V, i + 1>(value, index);
+	}
+
+	else throw std::runtime_error("checkpoint file has an unknown type");
+}
+
+static libSphysl::data_t get_value(reader_t& reader) {
+	libSphysl::data_t value;
+	emplace(value, reader.get<uint64_t>());
+
+	std::visit([&](auto& v) {
+		typedef std::decay_t<decltype(v)> T;
+
+		if constexpr(std::is_same_v<T, libSphysl::binary_t>) {
+			v.length = reader.get<uint64_t>();
+			v.value = new char[v.length];
+			std::memcpy(v.value, reader.take(v.length), v.length);
+		}
+
+		else v = reader.get<T>();
+	}, value);
+
+	return value;
+}
+
+static void get_config(reader_t& reader, libSphysl::config_t& config) {
+	for(auto i = reader.get<uint64_t>(); i; i--) {
+		const auto id = get_string(reader);
+		config[id] = get_value(reader);
+	}
+}
+
+static void write_column(
+	writer_t& writer, const std::string& id,
+	const libSphysl::data_vector_t& column
+){
+	auto& buffer = writer.file.buffer;
+	put(buffer, id);
+	put(buffer, uint64_t{column.index()});
+
+	std::visit([&](const auto& vec) {
+		typedef typename std::decay_t<decltype(vec)>::value_type T;
+		put(buffer, uint64_t{vec.size()});
+
+		/* Most columns can be written out as they are. */
+		if constexpr(!std::is_same_v<T, bool>
+			&& !std::is_same_v<T, libSphysl::binary_t>
+		){
+			const auto data = reinterpret_cast<const char*>(
+				vec.data()
+			);
+
+			write_chunks(
+				writer, id, column.index(),
+				data, vec.size() * sizeof(T)
+			);
+
+			return;
+		}
+
+		writer.pad();
+
+		/* Booleans are packed into bits in a std::vector, so they're
+		 * expanded into bytes first, and binary_t's have to be
+		 * gathered from wherever they are. */
+		if constexpr(std::is_same_v<T, bool>) {
+			for(const auto i: vec) buffer.push_back(i);
+		}
+
+		else if constexpr(std::is_same_v<T, libSphysl::binary_t>) {
+			for(const auto& i: vec) put(buffer, uint64_t{i.length});
+
+			for(const auto& i: vec) buffer.append(
+				static_cast<const char*>(i.value), i.length
+			);
+		}
+
+		writer.file.flush();
+	}, column);
+}
+
+static void write_chunks(
+	writer_t& writer, const std::string& id, size_t type,
+	const char* data, size_t bytes
+){
+	const auto count = (bytes + chunk_size - 1) / chunk_size;
+	auto& buffer = writer.file.buffer;
+	put(buffer, uint64_t{count});
+
+	/* We can only refer back to the earlier chunks if the column has the
+	 * same number of them, and they can't have changed types since the
+	 * type is part of the hash. */
+	const std::vector<libSphysl::chunk_t>* earlier = nullptr;
+
+	if(writer.earlier && writer.earlier -> chunks.count(id)) {
+		earlier = &writer.earlier -> chunks.at(id);
+		if(earlier -> size() != count) earlier = nullptr;
+	}
+
+	/* The chunks we write out go right after the entry in order, so we
+	 * can work out where they'll be ahead of time. */
+	const auto start = writer.file.size() + count * 2 * sizeof(uint64_t);
+	auto next = start + (alignment - start % alignment) % alignment;
+
+	const auto file = writer.earlier? writer.earlier -> files.size(): 0;
+	std::vector<libSphysl::chunk_t> chunks(count);
+	std::vector<bool> dirty(count, true);
+
+	for(size_t i = 0; i < count; i++) {
+		const auto offset = i * chunk_size;
+		const auto size = std::min(chunk_size, bytes - offset);
+
+		/* Full checkpoints don't need to hash anything. */
+		if(writer.earlier) {
+			chunks[i].hash = hash(data + offset, size, type);
+		}
+
+		if(earlier && (*earlier)[i].hash == chunks[i].hash) {
+			chunks[i] = (*earlier)[i];
+			dirty[i] = false;
+
+			put(buffer, uint64_t{chunks[i].file + 1});
+			put(buffer, uint64_t{chunks[i].offset});
+			continue;
+		}
+
+		chunks[i].file = file;
+		chunks[i].offset = next;
+		next += size;
+
+		put(buffer, uint64_t{0});
+		put(buffer, uint64_t{chunks[i].offset});
+	}
+
+	writer.pad();
+
+	/* Write out each run of changed chunks in one go; the writes go out
+	 * together, and the columns can't change before they're finished. */
+	for(size_t i = 0; i < count;) {
+		if(!dirty[i]) {
+			i++; continue;
+		}
+
+		size_t j = i;
+		while(j < count && dirty[j]) j++;
+
+		const auto offset = i * chunk_size;
+		const auto size = std::min(j * chunk_size, bytes) - offset;
+
+		writer.file.write(data + offset, size);
+		i = j;
+	}
+
+	if(writer.earlier) writer.chunks[id] = std::move(chunks);
+}
+
+static libSphysl::data_vector_t read_column(
+	reader_t& reader, size_t type, size_t size,
+	const libSphysl::storage_t& storage
+){
+	libSphysl::data_vector_t column;
+	emplace(column, type);
+
+	std::visit([&](auto& vec) {
+		typedef typename std::decay_t<decltype(vec)>::value_type T;
+		vec = std::decay_t<decltype(vec)>(storage);
+
+		constexpr auto chunked = !std::is_same_v<T, bool>
+			&& !std::is_same_v<T, libSphysl::binary_t>;
+
+		/* Skip over the padding to get to the data. */
+		if(!chunked || reader.format == 1) reader.take(
+			(alignment - reader.offset % alignment) % alignment
+		);
+
+		if constexpr(std::is_same_v<T, bool>) {
+			const auto bytes = reader.take(size);
+			vec.assign(bytes, bytes + size);
+		}
+
+		else if constexpr(std::is_same_v<T, libSphysl::binary_t>) {
+			vec.resize(size);
+
+			for(auto& i: vec) i.length = reader.get<uint64_t>();
+			for(auto& i: vec) {
+				const auto bytes = reader.take(i.length);
+				i.value = new char[i.length];
+				std::memcpy(i.value, bytes, i.length);
+			}
+		}
+
+		else {
+			if(size > SIZE_MAX / sizeof(T)) {
+				throw std::runtime_error(
+					"checkpoint file is truncated"
+				);
+			}
+
+			const auto bytes = size * sizeof(T);
+			vec.resize(size);
+
+			auto data = reinterpret_cast<char*>(vec.data());
+			if(reader.format == 1) {
+				std::memcpy(data, reader.take(bytes), bytes);
+			}
+
+			else read_chunks(reader, data, bytes);
+		}
+	}, column);
+
+	return column;
+}
+
+static void read_chunks(reader_t& reader, char* data, size_t bytes) {
+	const auto count = reader.get<uint64_t>();
+
+	if(count != (bytes + chunk_size - 1) / chunk_size) {
+		throw std::runtime_error("checkpoint file has a broken column");
+	}
+
+	/* Copy over the chunks from wherever they are, keeping track of the
+	 * end of the ones in this file, since that's where we continue. */
+	std::vector<std::pair<uint64_t, uint64_t>> chunks(count);
+	for(auto& [file, offset]: chunks) {
+		file = reader.get<uint64_t>();
+		offset = reader.get<uint64_t>();
+	}
+
+	auto end = reader.offset + (alignment - reader.offset % alignment)
+		% alignment;
+
+	for(size_t i = 0; i < count; i++) {
+		const auto [file, offset] = chunks[i];
+		const auto size = std::min(chunk_size, bytes - i * chunk_size);
+
+		std::memcpy(
+			data + i * chunk_size,
+			reader.chunk(file, offset, size), size
+		);
+
+		if(!file) end = std::max<size_t>(end, offset + size);
+	}
+
+	reader.offset = end;
+}
+
+static uint64_t hash(const char* data, size_t bytes, uint64_t seed) {
+	/* This is a single lane of MurmurHash3's 64-bit mixing, which is more
+	 * than enough to tell if a chunk has changed and about as fast as we
+	 * can read memory. */
+	const auto rotl = [](uint64_t x, int r) {
+		return (x << r) | (x >> (64 - r));
+	};
+
+	const auto mix = [](uint64_t x) {
+		x ^= x >> 33; x *= 0xff51afd7ed558ccd;
+		x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53;
+		x ^= x >> 33; return x;
+	};
+
+	uint64_t h = mix(seed + bytes);
+	size_t i = 0;
+
+	for(; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+		uint64_t k;
+		std::memcpy(&k, data + i, sizeof(uint64_t));
+
+		k *= 0x87c37b91114253d5; k = rotl(k, 31);
+		k *= 0x4cf5ad432745937f;
+
+		h ^= k; h = rotl(h, 27) * 5 + 0x52dce729;
+	}
+
+	/* The columns are made of 8-byte values, so this hardly happens. */
+	for(; i < bytes; i++) {
+		h = (h ^ static_cast<unsigned char>(data[i])) * 0x100000001b3;
+	}
+
+	return mix(h);
+}
+
+[[noreturn]] static void fail(const std::string& message) {
+	throw std::runtime_error(message + ": " + std::strerror(errno));
+}
+
+/* [1] A. Appleby, "MurmurHash3",
+ *     <https://github.com/aappleby/smhasher/wiki/MurmurHash3>. */
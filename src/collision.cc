@@ -0,0 +1,1193 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl/collision.h>
+#include <libSphysl/utility.h>
+
+/* Structure Declarations */
+
+/* Every source file has its own arg_t, so they're kept in an anonymous
+ * namespace to stop the linker from merging their destructor<arg_t>'s. */
+namespace {
+
+/* The bounds of the entities in a range, and the furthest that any of their
+ * boxes goes out along any axis. */
+struct bound_t {
+	libSphysl::vec3_t min, max;
+	double reach;
+};
+
+/* A cell of the grid, with its key and the entities in it, as a range of the
+ * sorted keys. */
+struct cell_t {
+	uint64_t key;
+	size_t first, last;
+};
+
+/* The entities, which is all that the collisions themselves need. */
+struct bodies_t {
+	const size_t total; // Number of entities.
+
+	libSphysl::utility::slice_t<double> m, x, y, z, v_x, v_y, v_z;
+	libSphysl::utility::slice_t<double> width, height, depth;
+};
+
+/* This is everything the stages of a tick share with the grid. */
+struct grid_t: bodies_t {
+	/* The ranges of entities that each thread handles, and the bounds
+	 * of the entities in each of them. */
+	std::vector<std::pair<size_t, size_t>> ranges;
+	std::vector<bound_t> bounds;
+
+	/* The key of the cell each entity is in, sorted; the cells that have
+	 * any entities in them, in the same order; and the columns of cells
+	 * along x, as ranges of the cells, with the even and odd ones listed
+	 * separately. */
+	std::vector<std::pair<uint64_t, size_t>> keys;
+	std::vector<cell_t> cells;
+
+	std::vector<std::pair<size_t, size_t>> columns;
+	std::array<std::vector<size_t>, 2> passes;
+};
+
+/* This is an entity's box in the sorted list, along the axis the list is
+ * sorted along, and then the other two in turn. */
+struct box_t {
+	double lower, upper;
+	double min_1, max_1, min_2, max_2;
+
+	size_t entity;
+};
+
+/* The ranges of boxes that each thread looks for overlaps with, and the pairs
+ * of entities that each thread found overlapping, for sweep and prune and the
+ * bounding volume hierarchy alike. */
+struct found_t: bodies_t {
+	std::vector<std::pair<size_t, size_t>> ranges;
+	std::vector<std::vector<std::pair<size_t, size_t>>> pairs;
+};
+
+/* This is what sweep and prune keeps from one tick to the next. */
+struct sweep_t: found_t {
+	/* The axis the list is sorted along, and whether it's been sorted
+	 * yet; and the boxes, sorted by their lower ends. */
+	size_t axis;
+	bool sorted;
+
+	std::vector<box_t> order;
+};
+
+/* This is what the bounding volume hierarchy's stages share. */
+struct hierarchy_t: found_t {
+	std::shared_ptr<libSphysl::collision::bvh_t> tree;
+};
+
+/* There's one of these for every thread in every stage, and the stages that
+ * can't be split up just have the one. Only one of the three is set. */
+struct arg_t {
+	std::shared_ptr<grid_t> grid;
+	std::shared_ptr<sweep_t> sweep;
+	std::shared_ptr<hierarchy_t> hierarchy;
+
+	size_t range; // Index of our range in the ranges.
+};
+
+}
+
+/* Constants Declarations */
+
+/* The keys are the coordinates of the cells along z, y and x, from the least
+ * significant bits up, with 21 bits each. */
+static const size_t bits = 21;
+static const uint64_t mask = (uint64_t{1} << bits) - 1;
+
+/* The cells that each cell's entities are tested against, other than its own,
+ * as the offsets of their coordinates. Only half of the cells around it are
+ * listed, since the other half test themselves against it, and the cells in
+ * the next column along x all come last. */
+static const int neighbours[13][3] = {
+	{0, 0, 1}, {0, 1, -1}, {0, 1, 0}, {0, 1, 1},
+
+	{1, -1, -1}, {1, -1, 0}, {1, -1, 1},
+	{1, 0, -1}, {1, 0, 0}, {1, 0, 1},
+	{1, 1, -1}, {1, 1, 0}, {1, 1, 1}
+};
+
+/* The most places that the entities can move in the sorted list in all before
+ * it's sorted from scratch, per entity. */
+static const size_t shift_limit = 8;
+
+/* The bounding volume hierarchy's leaves hold at most this many boxes, and
+ * the boxes are put into this many bins along an axis to work out where to
+ * split them. Past the given depth, they're split at the median instead, so
+ * the tree can't get too deep, and the tree is built again once the nodes'
+ * surface area has grown by the given ratio. */
+static const size_t leaf_size = 4;
+static const size_t bins = 16;
+static const size_t median_depth = 48;
+static const double rebuild_ratio = 1.5;
+
+/* Function Declarations */
+
+/* These are the calculators for each stage of the grid, in the order that they
+ * run. The collider runs twice, once for the even columns and once for the
+ * odd ones. */
+static void bounder(void* arg);
+static void keyer(void* arg);
+static void merger(void* arg);
+static void indexer(void* arg);
+template<size_t parity> static void collider(void* arg);
+
+/* These are the same for sweep and prune, and then for the bounding volume
+ * hierarchy, which shares the responder. */
+static void sorter(void* arg);
+static void sweeper(void* arg);
+static void responder(void* arg);
+
+static void refitter(void* arg);
+static void finder(void* arg);
+
+/* This builds the bounding volume hierarchy from scratch over its boxes from
+ * first to last, putting its nodes after the ones already there. */
+static void build(
+	libSphysl::collision::bvh_t& tree, size_t first, size_t last,
+	size_t depth
+);
+
+/* These get the surface area of a node's box, and check if two boxes
+ * overlap. */
+static double area(const libSphysl::collision::bvh_t::node_t& node);
+
+static bool overlap(
+	const libSphysl::vec3_t& min_1, const libSphysl::vec3_t& max_1,
+	const libSphysl::vec3_t& min_2, const libSphysl::vec3_t& max_2
+);
+
+/* This gets the entities from the sandbox. */
+static bodies_t gather(libSphysl::sandbox_t* s);
+
+/* This works out the corner of the grid and the side of its cells, and
+ * returns false if none of the entities have boxes, in which case nothing
+ * can collide. */
+static bool layout(
+	const grid_t& grid, libSphysl::vec3_t& corner, double& side
+);
+
+/* This collides two entities if their boxes overlap. */
+static void collide(bodies_t& bodies, size_t a, size_t b);
+
+/* This bounces two entities off each other along a single axis, given their
+ * positions and velocities along it, and how far apart they have to be to
+ * just touch. */
+static void bounce(
+	double& p_1, double& p_2, double& u_1, double& u_2,
+	double m_1, double m_2, double reach
+);
+
+/* Function Definitions */
+
+std::list<libSphysl::engine_t> libSphysl::collision::grid(
+	libSphysl::sandbox_t* s
+){
+	/* Get the variables we need from the config. */
+	const auto total = std::get<size_t>(s -> config_get("entity count"));
+	const auto threads = s -> threads.size(); // Not stored in config.
+
+	auto grid = std::make_shared<grid_t>(grid_t{
+		gather(s), {}, {}, {}, {}, {}, {}
+	});
+
+	/* Give each thread its own range of entities. */
+	for(const auto& range: libSphysl::utility::divide_range(
+		0, total, threads
+	)) if(range.first != range.second) grid -> ranges.push_back(range);
+
+	grid -> bounds.resize(grid -> ranges.size());
+	grid -> keys.resize(total);
+
+	/* Set up the engines for the stages. The ones that run in parallel
+	 * get an arg for every range, and the rest get just the one. */
+	std::list<libSphysl::engine_t> engines;
+
+	for(const auto calculator: {
+		bounder, keyer, merger, indexer, collider<0>, collider<1>
+	}){
+		libSphysl::engine_t engine;
+
+		engine.calculator = calculator;
+		engine.destructor = libSphysl::utility::destructor<arg_t>;
+
+		const auto parallel = calculator != merger
+			&& calculator != indexer;
+
+		const auto args = parallel? grid -> ranges.size(): 1;
+
+		for(size_t i = 0; i < args; i++) {
+			auto arg = new arg_t{grid, nullptr, nullptr, i};
+			engine.args.push_back(reinterpret_cast<void*>(arg));
+		}
+
+		engines.push_back(engine);
+	}
+
+	/* If the database is changed, we are regenerated the same way. */
+	engines.front().generator = [](libSphysl::sandbox_t* s) {
+		return libSphysl::collision::grid(s);
+	};
+
+	engines.front().span = engines.size();
+	return engines;
+}
+
+std::list<libSphysl::engine_t> libSphysl::collision::sweep_and_prune(
+	libSphysl::sandbox_t* s
+){
+	/* Get the variables we need from the config. */
+	const auto total = std::get<size_t>(s -> config_get("entity count"));
+	const auto threads = s -> threads.size(); // Not stored in config.
+
+	auto sweep = std::make_shared<sweep_t>(sweep_t{
+		{gather(s), {}, {}}, 0, false, {}
+	});
+
+	/* Give each thread its own range of the sorted list. */
+	for(const auto& range: libSphysl::utility::divide_range(
+		0, total, threads
+	)) if(range.first != range.second) sweep -> ranges.push_back(range);
+
+	sweep -> order.resize(total);
+	sweep -> pairs.resize(sweep -> ranges.size());
+
+	/* Set up the engines for the stages. The sweeper runs in parallel
+	 * and gets an arg for every range, and the rest get just the one. */
+	std::list<libSphysl::engine_t> engines;
+
+	for(const auto calculator: {sorter, sweeper, responder}) {
+		libSphysl::engine_t engine;
+
+		engine.calculator = calculator;
+		engine.destructor = libSphysl::utility::destructor<arg_t>;
+
+		const auto args = calculator == sweeper?
+			sweep -> ranges.size(): 1;
+
+		for(size_t i = 0; i < args; i++) {
+			auto arg = new arg_t{nullptr, sweep, nullptr, i};
+			engine.args.push_back(reinterpret_cast<void*>(arg));
+		}
+
+		engines.push_back(engine);
+	}
+
+	/* If the database is changed, we are regenerated the same way. */
+	engines.front().generator = [](libSphysl::sandbox_t* s) {
+		return libSphysl::collision::sweep_and_prune(s);
+	};
+
+	engines.front().span = engines.size();
+	return engines;
+}
+
+std::list<libSphysl::engine_t> libSphysl::collision::bvh(
+	libSphysl::sandbox_t* s
+){
+	return bvh(s, std::make_shared<libSphysl::collision::bvh_t>());
+}
+
+std::list<libSphysl::engine_t> libSphysl::collision::bvh(
+	libSphysl::sandbox_t* s,
+	std::shared_ptr<libSphysl::collision::bvh_t> tree
+){
+	/* Get the variables we need from the config. */
+	const auto total = std::get<size_t>(s -> config_get("entity count"));
+	const auto threads = s -> threads.size(); // Not stored in config.
+
+	auto hierarchy = std::make_shared<hierarchy_t>(hierarchy_t{
+		{gather(s), {}, {}}, tree
+	});
+
+	/* The tree is built again on the first tick. */
+	tree -> boxes.resize(total);
+	tree -> nodes.clear();
+
+	/* Give each thread its own range of the boxes. */
+	for(const auto& range: libSphysl::utility::divide_range(
+		0, total, threads
+	)) if(range.first != range.second) hierarchy -> ranges.push_back(range);
+
+	hierarchy -> pairs.resize(hierarchy -> ranges.size());
+
+	/* Set up the engines for the stages. The finder runs in parallel and
+	 * gets an arg for every range, and the rest get just the one. */
+	std::list<libSphysl::engine_t> engines;
+
+	for(const auto calculator: {refitter, finder, responder}) {
+		libSphysl::engine_t engine;
+
+		engine.calculator = calculator;
+		engine.destructor = libSphysl::utility::destructor<arg_t>;
+
+		const auto args = calculator == finder?
+			hierarchy -> ranges.size(): 1;
+
+		for(size_t i = 0; i < args; i++) {
+			auto arg = new arg_t{nullptr, nullptr, hierarchy, i};
+			engine.args.push_back(reinterpret_cast<void*>(arg));
+		}
+
+		engines.push_back(engine);
+	}
+
+	/* If the database is changed, we are regenerated the same way, with
+	 * the same tree. */
+	engines.front().generator = [tree](libSphysl::sandbox_t* s) {
+		return libSphysl::collision::bvh(s, tree);
+	};
+
+	engines.front().span = engines.size();
+	return engines;
+}
+
+void libSphysl::collision::bvh_t::query(
+	const libSphysl::vec3_t& min, const libSphysl::vec3_t& max,
+	std::vector<size_t>& found
+) const {
+	/* Walk the tree in order, using next to skip over the subtrees that
+	 * don't overlap. */
+	for(size_t n = 0; n < nodes.size();) {
+		const auto& node = nodes[n];
+
+		if(!overlap(min, max, node.min, node.max)) {
+			n = node.next;
+			continue;
+		}
+
+		if(node.next == n + 1) {
+			for(auto k = node.first; k < node.last; k++) {
+				const auto& box = boxes[k];
+
+				if(overlap(min, max, box.min, box.max)) {
+					found.push_back(box.entity);
+				}
+			}
+		}
+
+		n++;
+	}
+}
+
+static void bounder(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& grid = *data.grid;
+
+	/* Find the bounds of the entities in our range, and the biggest of
+	 * their boxes. */
+	const auto [start, stop] = grid.ranges[data.range];
+
+	libSphysl::vec3_t min{grid.x[start], grid.y[start], grid.z[start]};
+	auto max = min;
+	double reach = 0.0;
+
+	for(size_t i = start; i < stop; i++) {
+		min.x = std::min(min.x, grid.x[i]);
+		min.y = std::min(min.y, grid.y[i]);
+		min.z = std::min(min.z, grid.z[i]);
+
+		max.x = std::max(max.x, grid.x[i]);
+		max.y = std::max(max.y, grid.y[i]);
+		max.z = std::max(max.z, grid.z[i]);
+
+		reach = std::max({
+			reach, grid.width[i], grid.height[i], grid.depth[i]
+		});
+	}
+
+	grid.bounds[data.range] = {min, max, reach};
+}
+
+static void keyer(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& grid = *data.grid;
+
+	/* Every thread works out the layout for itself, since it's cheap. */
+	libSphysl::vec3_t corner;
+	double side;
+
+	if(!layout(grid, corner, side)) return;
+
+	const auto cell = [&](double v, double low) {
+		const auto c = static_cast<uint64_t>((v - low) / side);
+		return std::min(c, mask);
+	};
+
+	/* Compute the key of every entity in our range and sort them, so
+	 * that the merger only has to merge the sorted runs. */
+	const auto [start, stop] = grid.ranges[data.range];
+
+	for(size_t i = start; i < stop; i++) {
+		grid.keys[i] = {
+			(cell(grid.x[i], corner.x) << (2 * bits))
+			| (cell(grid.y[i], corner.y) << bits)
+			| cell(grid.z[i], corner.z), i
+		};
+	}
+
+	std::sort(grid.keys.begin() + start, grid.keys.begin() + stop);
+}
+
+static void merger(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& grid = *reinterpret_cast<arg_t*>(arg) -> grid;
+
+	libSphysl::vec3_t corner;
+	double side;
+
+	if(!layout(grid, corner, side)) return;
+
+	/* Merge neighbouring runs pairwise until there's only one left. */
+	const auto& ranges = grid.ranges;
+	const auto keys = grid.keys.begin();
+
+	for(size_t width = 1; width < ranges.size(); width *= 2) {
+		for(size_t i = 0; i + width < ranges.size(); i += width * 2) {
+			const auto last = std::min(
+				i + width * 2, ranges.size()
+			) - 1;
+
+			std::inplace_merge(
+				keys + ranges[i].first,
+				keys + ranges[i + width].first,
+				keys + ranges[last].second
+			);
+		}
+	}
+}
+
+static void indexer(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& grid = *reinterpret_cast<arg_t*>(arg) -> grid;
+
+	grid.cells.clear();
+	grid.columns.clear();
+
+	grid.passes[0].clear();
+	grid.passes[1].clear();
+
+	libSphysl::vec3_t corner;
+	double side;
+
+	if(!layout(grid, corner, side)) return;
+
+	/* Each run of equal keys is a cell, and each run of cells with the
+	 * same coordinate along x is a column. */
+	for(size_t i = 0; i < grid.total; i++) {
+		const auto key = grid.keys[i].first;
+
+		if(grid.cells.empty() || grid.cells.back().key != key) {
+			grid.cells.push_back({key, i, i});
+		}
+
+		grid.cells.back().last = i + 1;
+	}
+
+	for(size_t c = 0; c < grid.cells.size(); c++) {
+		const auto x = grid.cells[c].key >> (2 * bits);
+
+		if(grid.columns.empty() || (
+			grid.cells[grid.columns.back().first].key >> (2 * bits)
+		) != x) {
+			grid.passes[x % 2].push_back(grid.columns.size());
+			grid.columns.push_back({c, c});
+		}
+
+		grid.columns.back().second = c + 1;
+	}
+}
+
+template<size_t parity> static void collider(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& grid = *data.grid;
+
+	/* Take our share of this pass's columns. */
+	const auto& pass = grid.passes[parity];
+	const auto [first, last] = libSphysl::utility::divide_range(
+		0, pass.size(), grid.ranges.size()
+	)[data.range];
+
+	const auto outside = [](int64_t v) {
+		return v < 0 || v > int64_t(mask);
+	};
+
+	for(auto p = first; p < last; p++) {
+		const auto [start, stop] = grid.columns[pass[p]];
+
+		/* The cells that each offset lands on only ever go up as we go
+		 * through the column, so each offset keeps its place in the
+		 * cells rather than searching for them every time. The ones in
+		 * the next column along x start from wherever it does. */
+		std::array<size_t, 13> places;
+
+		for(size_t k = 0; k < 13; k++) {
+			places[k] = neighbours[k][0]? stop: start;
+		}
+
+		for(auto c = start; c < stop; c++) {
+			const auto& cell = grid.cells[c];
+
+			/* Test the entities in the cell against each other,
+			 * and then against the ones in the cells around it. */
+			for(auto i = cell.first; i < cell.last; i++) {
+				for(auto j = i + 1; j < cell.last; j++) {
+					collide(
+						grid, grid.keys[i].second,
+						grid.keys[j].second
+					);
+				}
+			}
+
+			const int64_t x = cell.key >> (2 * bits);
+			const int64_t y = (cell.key >> bits) & mask;
+			const int64_t z = cell.key & mask;
+
+			for(size_t k = 0; k < 13; k++) {
+				const auto [d_x, d_y, d_z] = neighbours[k];
+
+				const auto n_x = x + d_x, n_y = y + d_y;
+				const auto n_z = z + d_z;
+
+				if(outside(n_x) || outside(n_y)
+					|| outside(n_z)) continue;
+
+				const auto key = (uint64_t(n_x) << (2 * bits))
+					| (uint64_t(n_y) << bits)
+					| uint64_t(n_z);
+
+				auto& place = places[k];
+
+				while(place < grid.cells.size()
+					&& grid.cells[place].key < key) place++;
+
+				if(place == grid.cells.size()) continue;
+
+				const auto& other = grid.cells[place];
+				if(other.key != key) continue;
+
+				for(auto i = cell.first; i < cell.last; i++) {
+					for(auto j = other.first;
+						j < other.last; j++
+					) collide(
+						grid, grid.keys[i].second,
+						grid.keys[j].second
+					);
+				}
+			}
+		}
+	}
+}
+
+static void sorter(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& sweep = *reinterpret_cast<arg_t*>(arg) -> sweep;
+
+	const std::array<const libSphysl::utility::slice_t<double>*, 3>
+		positions{&sweep.x, &sweep.y, &sweep.z},
+		reaches{&sweep.width, &sweep.height, &sweep.depth};
+
+	if(!sweep.total) return;
+
+	/* The list is sorted along whichever axis the entities are most
+	 * spread out along, going by the variance of their positions. It
+	 * only moves over to another axis once that axis is clearly better,
+	 * since it has to be sorted from scratch when it does. */
+	std::array<double, 3> sums{}, squares{};
+
+	for(size_t i = 0; i < sweep.total; i++) {
+		for(size_t a = 0; a < 3; a++) {
+			const auto p = (*positions[a])[i];
+			sums[a] += p; squares[a] += p * p;
+		}
+	}
+
+	std::array<double, 3> spreads;
+	for(size_t a = 0; a < 3; a++) {
+		spreads[a] = squares[a] - sums[a] * sums[a] / sweep.total;
+	}
+
+	const auto best = std::max_element(spreads.begin(), spreads.end())
+		- spreads.begin();
+
+	auto sorted = sweep.sorted
+		&& spreads[best] <= 2.0 * spreads[sweep.axis];
+	if(!sorted) sweep.axis = best;
+
+	/* Bring the boxes up to date in the order they're already in. */
+	const auto axis_1 = (sweep.axis + 1) % 3;
+	const auto axis_2 = (sweep.axis + 2) % 3;
+
+	const auto& p_0 = *positions[sweep.axis];
+	const auto& r_0 = *reaches[sweep.axis];
+	const auto& p_1 = *positions[axis_1];
+	const auto& r_1 = *reaches[axis_1];
+	const auto& p_2 = *positions[axis_2];
+	const auto& r_2 = *reaches[axis_2];
+
+	for(size_t k = 0; k < sweep.total; k++) {
+		const auto i = sorted? sweep.order[k].entity: k;
+
+		sweep.order[k] = {
+			p_0[i] - r_0[i], p_0[i] + r_0[i],
+			p_1[i] - r_1[i], p_1[i] + r_1[i],
+			p_2[i] - r_2[i], p_2[i] + r_2[i], i
+		};
+	}
+
+	/* The entities don't move far in a tick, so the list is nearly sorted
+	 * already, and an insertion sort puts it right in close to linear
+	 * time. If they've moved around too much, it's sorted from scratch
+	 * instead. Ties go to the lower entity, so the order is the same
+	 * either way. */
+	const auto before = [](const box_t& a, const box_t& b) {
+		if(a.lower != b.lower) return a.lower < b.lower;
+		return a.entity < b.entity;
+	};
+
+	auto shifts = sorted? shift_limit * sweep.total: 0;
+
+	for(size_t k = 1; sorted && k < sweep.total; k++) {
+		const auto box = sweep.order[k];
+		auto l = k;
+
+		for(; l > 0 && before(box, sweep.order[l - 1]) && shifts; l--) {
+			sweep.order[l] = sweep.order[l - 1];
+			shifts--;
+		}
+
+		sweep.order[l] = box;
+		if(!shifts) sorted = false;
+	}
+
+	if(!sorted) std::sort(sweep.order.begin(), sweep.order.end(), before);
+	sweep.sorted = true;
+}
+
+static void sweeper(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& sweep = *data.sweep;
+
+	/* Each entity's box overlaps with those of the entities after it in
+	 * the list along the axis until their lower ends pass its upper
+	 * one, and those that overlap along the other two axes as well are
+	 * noted down. The boxes are kept in the order of the list, so this
+	 * goes through memory in order. */
+	const auto [start, stop] = sweep.ranges[data.range];
+	auto& pairs = sweep.pairs[data.range];
+
+	pairs.clear();
+
+	for(auto k = start; k < stop; k++) {
+		const auto& a = sweep.order[k];
+
+		for(auto l = k + 1; l < sweep.total; l++) {
+			const auto& b = sweep.order[l];
+			if(!(b.lower < a.upper)) break;
+
+			if(!(a.min_1 < b.max_1 && b.min_1 < a.max_1)) continue;
+			if(!(a.min_2 < b.max_2 && b.min_2 < a.max_2)) continue;
+
+			pairs.push_back({a.entity, b.entity});
+		}
+	}
+}
+
+static void responder(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& found = data.sweep? static_cast<found_t&>(*data.sweep):
+		static_cast<found_t&>(*data.hierarchy);
+
+	/* The pairs are collided in the order of the list or the tree, which
+	 * doesn't depend on how it was split between the threads. Each pair
+	 * is tested again, since the collisions before it may have pushed
+	 * its entities apart. */
+	for(const auto& pairs: found.pairs) {
+		for(const auto& [a, b]: pairs) collide(found, a, b);
+	}
+}
+
+static void refitter(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& hierarchy = *reinterpret_cast<arg_t*>(arg) -> hierarchy;
+	auto& tree = *hierarchy.tree;
+
+	/* Bring the boxes up to date in the order they're already in, or in
+	 * the order of the entities if the tree hasn't been built yet. */
+	const auto built = !tree.nodes.empty();
+
+	for(size_t k = 0; k < hierarchy.total; k++) {
+		const auto i = built? tree.boxes[k].entity: k;
+
+		const libSphysl::vec3_t reach{
+			hierarchy.width[i], hierarchy.height[i],
+			hierarchy.depth[i]
+		};
+
+		tree.boxes[k] = {
+			{
+				hierarchy.x[i] - reach.x,
+				hierarchy.y[i] - reach.y,
+				hierarchy.z[i] - reach.z
+			},{
+				hierarchy.x[i] + reach.x,
+				hierarchy.y[i] + reach.y,
+				hierarchy.z[i] + reach.z
+			}, i
+		};
+	}
+
+	/* Refit the nodes from the bottom up, which is backwards since the
+	 * children come after their parents. */
+	auto total = 0.0;
+
+	for(auto n = tree.nodes.size(); n-- > 0;) {
+		auto& node = tree.nodes[n];
+
+		const auto fit = [&](
+			const libSphysl::vec3_t& min,
+			const libSphysl::vec3_t& max
+		){
+			node.min.x = std::min(node.min.x, min.x);
+			node.min.y = std::min(node.min.y, min.y);
+			node.min.z = std::min(node.min.z, min.z);
+
+			node.max.x = std::max(node.max.x, max.x);
+			node.max.y = std::max(node.max.y, max.y);
+			node.max.z = std::max(node.max.z, max.z);
+		};
+
+		if(node.next == n + 1) {
+			const auto& box = tree.boxes[node.first];
+			node.min = box.min; node.max = box.max;
+
+			for(auto k = node.first + 1; k < node.last; k++) {
+				fit(tree.boxes[k].min, tree.boxes[k].max);
+			}
+		}
+
+		else {
+			const auto& left = tree.nodes[n + 1];
+			const auto& right = tree.nodes[left.next];
+
+			node.min = left.min; node.max = left.max;
+			fit(right.min, right.max);
+		}
+
+		total += area(node);
+	}
+
+	/* The tree gets worse as the entities move, so it's built again once
+	 * it's grown too much. */
+	if(built && total <= rebuild_ratio * tree.area) return;
+
+	tree.nodes.clear();
+	if(hierarchy.total) build(tree, 0, hierarchy.total, 0);
+
+	tree.area = 0.0;
+	for(const auto& node: tree.nodes) tree.area += area(node);
+}
+
+static void finder(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& hierarchy = *data.hierarchy;
+	const auto& tree = *hierarchy.tree;
+
+	/* Each box is looked up in the tree, and the boxes after it in the
+	 * tree that overlap with it are noted down. The subtrees that only
+	 * have boxes before it are skipped, so each pair is only found
+	 * once. The tree is walked in order, using next to skip over the
+	 * subtrees that don't overlap. */
+	const auto [start, stop] = hierarchy.ranges[data.range];
+	auto& pairs = hierarchy.pairs[data.range];
+
+	pairs.clear();
+
+	for(auto k = start; k < stop; k++) {
+		const auto& box = tree.boxes[k];
+
+		for(size_t n = 0; n < tree.nodes.size();) {
+			const auto& node = tree.nodes[n];
+
+			if(node.last <= k + 1 || !overlap(
+				box.min, box.max, node.min, node.max
+			)){
+				n = node.next;
+				continue;
+			}
+
+			if(node.next == n + 1) {
+				for(auto l = std::max(node.first, k + 1);
+					l < node.last; l++
+				){
+					const auto& other = tree.boxes[l];
+
+					if(overlap(
+						box.min, box.max,
+						other.min, other.max
+					)) pairs.push_back(
+						{box.entity, other.entity}
+					);
+				}
+			}
+
+			n++;
+		}
+	}
+}
+
+static void build(
+	libSphysl::collision::bvh_t& tree, size_t first, size_t last,
+	size_t depth
+){
+	/* Put a node down for the boxes, with a box around them all, and
+	 * work out the bounds of their centres as well. */
+	const auto n = tree.nodes.size();
+	tree.nodes.push_back({
+		tree.boxes[first].min, tree.boxes[first].max, first, last, 0
+	});
+
+	const auto centre = [](
+		const libSphysl::collision::bvh_t::box_t& box, size_t axis
+	){
+		if(axis == 0) return box.min.x + box.max.x;
+		if(axis == 1) return box.min.y + box.max.y;
+		return box.min.z + box.max.z;
+	};
+
+	auto& node = tree.nodes[n];
+	const auto& front = tree.boxes[first];
+
+	libSphysl::vec3_t low{
+		centre(front, 0), centre(front, 1), centre(front, 2)
+	}, high = low;
+
+	for(auto k = first; k < last; k++) {
+		const auto& box = tree.boxes[k];
+
+		node.min.x = std::min(node.min.x, box.min.x);
+		node.min.y = std::min(node.min.y, box.min.y);
+		node.min.z = std::min(node.min.z, box.min.z);
+
+		node.max.x = std::max(node.max.x, box.max.x);
+		node.max.y = std::max(node.max.y, box.max.y);
+		node.max.z = std::max(node.max.z, box.max.z);
+
+		low.x = std::min(low.x, centre(box, 0));
+		low.y = std::min(low.y, centre(box, 1));
+		low.z = std::min(low.z, centre(box, 2));
+
+		high.x = std::max(high.x, centre(box, 0));
+		high.y = std::max(high.y, centre(box, 1));
+		high.z = std::max(high.z, centre(box, 2));
+	}
+
+	/* Few enough boxes make a leaf. */
+	if(last - first <= leaf_size) {
+		node.next = n + 1;
+		return;
+	}
+
+	/* Otherwise, the boxes are split along the axis their centres are
+	 * most spread out along. */
+	const std::array<double, 3> spreads{
+		high.x - low.x, high.y - low.y, high.z - low.z
+	};
+
+	const size_t axis = std::max_element(spreads.begin(), spreads.end())
+		- spreads.begin();
+
+	const auto start = axis == 0? low.x: axis == 1? low.y: low.z;
+	const auto spread = spreads[axis];
+
+	/* The boxes are put into bins by their centres, and the split between
+	 * the bins is the one where the surface area of each side times the
+	 * number of boxes on it adds up to the least, since that's roughly
+	 * how many boxes a query into the node would have to go through. */
+	auto middle = first + (last - first) / 2;
+	auto median = depth >= median_depth || spread == 0.0;
+
+	const auto bin = [&](const libSphysl::collision::bvh_t::box_t& box) {
+		const auto b = static_cast<size_t>(
+			(centre(box, axis) - start) / spread * bins
+		);
+
+		return std::min(b, bins - 1);
+	};
+
+	if(!median) {
+		std::array<libSphysl::collision::bvh_t::node_t, bins> boxes;
+		std::array<size_t, bins> counts{};
+
+		for(auto k = first; k < last; k++) {
+			const auto& box = tree.boxes[k];
+			const auto b = bin(box);
+
+			auto& into = boxes[b];
+
+			if(!counts[b]++) {
+				into.min = box.min; into.max = box.max;
+				continue;
+			}
+
+			into.min.x = std::min(into.min.x, box.min.x);
+			into.min.y = std::min(into.min.y, box.min.y);
+			into.min.z = std::min(into.min.z, box.min.z);
+
+			into.max.x = std::max(into.max.x, box.max.x);
+			into.max.y = std::max(into.max.y, box.max.y);
+			into.max.z = std::max(into.max.z, box.max.z);
+		}
+
+		/* Sweep the bins from the right, noting down the cost of what's
+		 * to the right of each split, and then from the left. */
+		const auto merge = [](
+			libSphysl::collision::bvh_t::node_t& into,
+			const libSphysl::collision::bvh_t::node_t& from,
+			size_t count
+		){
+			if(!count) {into = from; return;}
+
+			into.min.x = std::min(into.min.x, from.min.x);
+			into.min.y = std::min(into.min.y, from.min.y);
+			into.min.z = std::min(into.min.z, from.min.z);
+
+			into.max.x = std::max(into.max.x, from.max.x);
+			into.max.y = std::max(into.max.y, from.max.y);
+			into.max.z = std::max(into.max.z, from.max.z);
+		};
+
+		std::array<double, bins> costs{};
+		libSphysl::collision::bvh_t::node_t side{};
+		size_t count = 0;
+
+		for(auto b = bins - 1; b > 0; b--) {
+			if(counts[b]) merge(side, boxes[b], count);
+			count += counts[b];
+
+			costs[b - 1] = count? area(side) * count: 0.0;
+		}
+
+		auto best = 0.0;
+		size_t split = 0; // None yet.
+		count = 0;
+
+		for(size_t b = 0; b < bins - 1; b++) {
+			if(counts[b]) merge(side, boxes[b], count);
+			count += counts[b];
+
+			if(!count || count == last - first) continue;
+
+			const auto cost = area(side) * count + costs[b];
+			if(!split || cost < best) {best = cost; split = b + 1;}
+		}
+
+		/* Put the boxes in the bins before the split first. */
+		if(split) middle = std::partition(
+			tree.boxes.begin() + first, tree.boxes.begin() + last,
+			[&](const libSphysl::collision::bvh_t::box_t& box) {
+				return bin(box) < split;
+			}
+		) - tree.boxes.begin();
+
+		else median = true;
+	}
+
+	/* If that didn't work out, or the tree's getting too deep, split them
+	 * at the median instead. Ties go to the lower entity, so the tree is
+	 * the same however the boxes were ordered. */
+	if(median) std::nth_element(
+		tree.boxes.begin() + first, tree.boxes.begin() + middle,
+		tree.boxes.begin() + last, [&](
+			const libSphysl::collision::bvh_t::box_t& a,
+			const libSphysl::collision::bvh_t::box_t& b
+		){
+			const auto c_a = centre(a, axis), c_b = centre(b, axis);
+			if(c_a != c_b) return c_a < c_b;
+			return a.entity < b.entity;
+		}
+	);
+
+	build(tree, first, middle, depth + 1);
+	build(tree, middle, last, depth + 1);
+
+	tree.nodes[n].next = tree.nodes.size();
+}
+
+static double area(const libSphysl::collision::bvh_t::node_t& node) {
+	const auto x = node.max.x - node.min.x;
+	const auto y = node.max.y - node.min.y;
+	const auto z = node.max.z - node.min.z;
+
+	return 2.0 * (x * y + y * z + z * x);
+}
+
+static bool overlap(
+	const libSphysl::vec3_t& min_1, const libSphysl::vec3_t& max_1,
+	const libSphysl::vec3_t& min_2, const libSphysl::vec3_t& max_2
+){
+	return min_1.x < max_2.x && min_2.x < max_1.x
+		&& min_1.y < max_2.y && min_2.y < max_1.y
+		&& min_1.z < max_2.z && min_2.z < max_1.z;
+}
+
+static bodies_t gather(libSphysl::sandbox_t* s) {
+	const auto total = std::get<size_t>(s -> config_get("entity count"));
+
+	/* Get the variables we need from the database, slicing uniform
+	 * columns with a stride of 0. */
+	const auto get_column = [&](const std::string& id) {
+		if(s -> database_uniform(id)) {
+			auto& v = std::get<double>(s -> uniform_get(id));
+			return libSphysl::utility::slice_t<double>(
+				&v, 0, 0, total
+			);
+		}
+
+		return libSphysl::utility::slice_t<double>(
+			std::get<libSphysl::column_t<double>>(
+				s -> database_get(id)
+			), 0, total
+		);
+	};
+
+	const auto get_axis = [&](const std::string& id) {
+		return libSphysl::utility::get_axis(s, id, 0, total);
+	};
+
+	return bodies_t{
+		total, get_column("mass"),
+
+		get_axis("x position"),
+		get_axis("y position"),
+		get_axis("z position"),
+
+		get_axis("x velocity"),
+		get_axis("y velocity"),
+		get_axis("z velocity"),
+
+		get_column("bounding box width"),
+		get_column("bounding box height"),
+		get_column("bounding box depth")
+	};
+}
+
+static bool layout(
+	const grid_t& grid, libSphysl::vec3_t& corner, double& side
+){
+	if(grid.bounds.empty()) return false;
+
+	/* Combine the bounds of each range. */
+	auto [min, max, reach] = grid.bounds[0];
+
+	for(const auto& bound: grid.bounds) {
+		min.x = std::min(min.x, bound.min.x);
+		min.y = std::min(min.y, bound.min.y);
+		min.z = std::min(min.z, bound.min.z);
+
+		max.x = std::max(max.x, bound.max.x);
+		max.y = std::max(max.y, bound.max.y);
+		max.z = std::max(max.z, bound.max.z);
+
+		reach = std::max(reach, bound.reach);
+	}
+
+	if(!(reach > 0.0)) return false;
+
+	/* Two boxes can only overlap if their positions are less than twice
+	 * the biggest reach apart along every axis, so that's as small as the
+	 * cells can be, but they're made bigger if there would be too many
+	 * of them to fit into the keys. */
+	const auto span = std::max({
+		max.x - min.x, max.y - min.y, max.z - min.z
+	});
+
+	corner = min;
+	side = std::max(2.0 * reach, span / double(mask));
+
+	return true;
+}
+
+static void collide(bodies_t& bodies, size_t a, size_t b) {
+	/* The boxes overlap if they do along every axis. */
+	const auto reach_x = bodies.width[a] + bodies.width[b];
+	const auto reach_y = bodies.height[a] + bodies.height[b];
+	const auto reach_z = bodies.depth[a] + bodies.depth[b];
+
+	if(std::abs(bodies.x[b] - bodies.x[a]) >= reach_x) return;
+	if(std::abs(bodies.y[b] - bodies.y[a]) >= reach_y) return;
+	if(std::abs(bodies.z[b] - bodies.z[a]) >= reach_z) return;
+
+	const auto m_a = bodies.m[a], m_b = bodies.m[b];
+
+	bounce(
+		bodies.x[a], bodies.x[b], bodies.v_x[a], bodies.v_x[b],
+		m_a, m_b, reach_x
+	);
+
+	bounce(
+		bodies.y[a], bodies.y[b], bodies.v_y[a], bodies.v_y[b],
+		m_a, m_b, reach_y
+	);
+
+	bounce(
+		bodies.z[a], bodies.z[b], bodies.v_z[a], bodies.v_z[b],
+		m_a, m_b, reach_z
+	);
+}
+
+static void bounce(
+	double& p_1, double& p_2, double& u_1, double& u_2,
+	double m_1, double m_2, double reach
+){
+	/* The velocities after an elastic collision in one dimension. */
+	const auto v_1 = ((m_1 - m_2) * u_1 + 2.0 * m_2 * u_2) / (m_1 + m_2);
+	const auto v_2 = ((m_2 - m_1) * u_2 + 2.0 * m_1 * u_1) / (m_1 + m_2);
+
+	u_1 = v_1; u_2 = v_2;
+
+	/* Push them apart so that their centre of mass stays where it is,
+	 * which is half of the overlap each if they weigh the same, and
+	 * leaves a far heavier entity all but where it was. */
+	const auto delta = p_2 - p_1;
+	const auto excess = reach - std::abs(delta);
+
+	const auto push_1 = excess * (m_2 / (m_1 + m_2));
+	const auto push_2 = excess - push_1;
+
+	if(delta > 0.0) {p_1 -= push_1; p_2 += push_2;}
+	else {p_1 += push_1; p_2 -= push_2;}
+}
@@ -0,0 +1,257 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <algorithm>
+#include <cmath>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl/gravity.h>
+#include <libSphysl/utility.h>
+
+/* Structure Declarations */
+
+/* Every source file has its own arg_t, so they're kept in an anonymous
+ * namespace to stop the linker from merging their destructor<arg_t>'s. */
+namespace {
+
+/* There's one of these for every thread's range of entities. */
+struct arg_t {
+	const double& G; // The gravitational constant.
+
+	const size_t total; // Number of entities in the sandbox.
+	const size_t count; // Number of entities in our range.
+
+	/* Every entity, for going through in blocks. */
+	libSphysl::utility::slice_t<double> m, x, y, z;
+
+	/* Our own range of entities. */
+	libSphysl::utility::slice_t<double> m_i, x_i, y_i, z_i;
+	libSphysl::utility::slice_t<double> F_x, F_y, F_z;
+
+	/* Our own positions and the sums of m / r^2 along each axis, copied
+	 * out and padded to a whole number of lanes. */
+	std::vector<double> own_x, own_y, own_z, a_x, a_y, a_z;
+
+	/* The current block of the other entities, copied out so that it's
+	 * contiguous no matter how the columns are stored. */
+	std::vector<double> block_m, block_x, block_y, block_z;
+};
+
+}
+
+/* Constants Declarations */
+
+/* The number of entities in a block. Four doubles for each of them comes to
+ * 16 KiB, which leaves half of a typical L1 cache for everything else. */
+static const size_t block_size = 512;
+
+/* The number of our own entities that are run against a block at once. Each
+ * of the other entities is loaded once for all of them, and the compiler can
+ * vectorise across them. */
+static const size_t lanes = 4;
+
+/* Function Declarations */
+
+/* This is the calculator that we will be using for the engines. */
+static void calculator(void* arg);
+
+/* This runs a number of lanes of our own entities, starting from the given
+ * one, against the current block. */
+static void kernel(arg_t& data, size_t first, size_t size);
+
+/* Function Definitions */
+
+libSphysl::engine_t libSphysl::gravity::classical(libSphysl::sandbox_t* s) {
+	/* This is the engine we will be returning. */
+	libSphysl::engine_t engine;
+
+	engine.calculator = calculator;
+	engine.destructor = libSphysl::utility::destructor<arg_t>;
+
+	/* If the database is changed, we are regenerated the same way. */
+	engine.generator = [](libSphysl::sandbox_t* s) {
+		return std::list<libSphysl::engine_t>{
+			libSphysl::gravity::classical(s)
+		};
+	};
+
+	/* Get the variables we need from the config. */
+	const auto total = std::get<size_t>(s -> config_get("entity count"));
+	const auto threads = s -> threads.size(); // Not stored in config.
+
+	const auto& G = std::get<double>(
+		s -> config_get("gravitational constant")
+	);
+
+	/* Get the variables we need from the database. If every entity has
+	 * the same mass, we slice the single value with a stride of 0. */
+	const auto uniform = s -> database_uniform("mass");
+
+	const auto get_masses = [&](size_t start, size_t stop) {
+		if(uniform) {
+			auto& m = std::get<double>(s -> uniform_get("mass"));
+			return libSphysl::utility::slice_t<double>(
+				&m, 0, start, stop
+			);
+		}
+
+		return libSphysl::utility::slice_t<double>(
+			std::get<libSphysl::column_t<double>>(
+				s -> database_get("mass")
+			), start, stop
+		);
+	};
+
+	const auto get_axis = [&](
+		const std::string& id, size_t start, size_t stop
+	){
+		return libSphysl::utility::get_axis(s, id, start, stop);
+	};
+
+	/* Give each thread its own range of entities. */
+	const auto ranges = libSphysl::utility::divide_range(0, total, threads);
+
+	for(const auto& [start, stop]: ranges) {
+		if(start == stop) continue;
+
+		const auto count = stop - start;
+		const auto padded = (count + lanes - 1) / lanes * lanes;
+
+		auto arg = new arg_t{
+			G, total, count,
+
+			get_masses(0, total),
+			get_axis("x position", 0, total),
+			get_axis("y position", 0, total),
+			get_axis("z position", 0, total),
+
+			get_masses(start, stop),
+			get_axis("x position", start, stop),
+			get_axis("y position", start, stop),
+			get_axis("z position", start, stop),
+
+			get_axis("x force", start, stop),
+			get_axis("y force", start, stop),
+			get_axis("z force", start, stop),
+
+			std::vector<double>(padded),
+			std::vector<double>(padded),
+			std::vector<double>(padded),
+
+			std::vector<double>(padded),
+			std::vector<double>(padded),
+			std::vector<double>(padded),
+
+			std::vector<double>(block_size),
+			std::vector<double>(block_size),
+			std::vector<double>(block_size),
+			std::vector<double>(block_size)
+		};
+
+		engine.args.push_back(reinterpret_cast<void*>(arg));
+	}
+
+	return engine;
+}
+
+static void calculator(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+
+	/* Copy out our own positions and clear the sums. */
+	for(size_t i = 0; i < data.count; i++) {
+		data.own_x[i] = data.x_i[i];
+		data.own_y[i] = data.y_i[i];
+		data.own_z[i] = data.z_i[i];
+	}
+
+	std::fill(data.a_x.begin(), data.a_x.end(), 0.0);
+	std::fill(data.a_y.begin(), data.a_y.end(), 0.0);
+	std::fill(data.a_z.begin(), data.a_z.end(), 0.0);
+
+	/* Go through all of the entities a block at a time, running each of
+	 * our own against it while it's still in the cache. */
+	for(size_t start = 0; start < data.total; start += block_size) {
+		const auto size = std::min(block_size, data.total - start);
+
+		for(size_t j = 0; j < size; j++) {
+			data.block_m[j] = data.m[start + j];
+			data.block_x[j] = data.x[start + j];
+			data.block_y[j] = data.y[start + j];
+			data.block_z[j] = data.z[start + j];
+		}
+
+		for(size_t i = 0; i < data.count; i += lanes) {
+			kernel(data, i, size);
+		}
+	}
+
+	/* F = G * m_i * sum(m_j * r / |r|^3) */
+	for(size_t i = 0; i < data.count; i++) {
+		const auto k = data.G * data.m_i[i];
+
+		data.F_x[i] += k * data.a_x[i];
+		data.F_y[i] += k * data.a_y[i];
+		data.F_z[i] += k * data.a_z[i];
+	}
+}
+
+static void kernel(arg_t& data, size_t first, size_t size) {
+	/* Plain pointers and local sums let the compiler keep everything in
+	 * registers and vectorise the inner loop. */
+	const auto m = data.block_m.data(), x = data.block_x.data();
+	const auto y = data.block_y.data(), z = data.block_z.data();
+
+	double x_i[lanes], y_i[lanes], z_i[lanes];
+	double a_x[lanes]{}, a_y[lanes]{}, a_z[lanes]{};
+
+	for(size_t l = 0; l < lanes; l++) {
+		x_i[l] = data.own_x[first + l];
+		y_i[l] = data.own_y[first + l];
+		z_i[l] = data.own_z[first + l];
+	}
+
+	for(size_t j = 0; j < size; j++) {
+		for(size_t l = 0; l < lanes; l++) {
+			const auto d_x = x[j] - x_i[l];
+			const auto d_y = y[j] - y_i[l];
+			const auto d_z = z[j] - z_i[l];
+
+			const auto r_sq = d_x * d_x + d_y * d_y + d_z * d_z;
+
+			/* Written this way, -Ofast turns the inverse square
+			 * root into a hardware estimate refined by a Newton
+			 * step wherever the target has one for doubles, rather
+			 * than a square root and a division. The select skips
+			 * the entity itself without a branch. */
+			const auto r_inv = 1.0 / std::sqrt(r_sq);
+			const auto k = m[j] * r_inv * r_inv * r_inv;
+			const auto k_j = r_sq > 0.0? k : 0.0;
+
+			a_x[l] += k_j * d_x;
+			a_y[l] += k_j * d_y;
+			a_z[l] += k_j * d_z;
+		}
+	}
+
+	for(size_t l = 0; l < lanes; l++) {
+		data.a_x[first + l] += a_x[l];
+		data.a_y[first + l] += a_y[l];
+		data.a_z[first + l] += a_z[l];
+	}
+}
@@ -0,0 +1,524 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+/* Including System Headerfiles */
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl/io.h>
+
+/* Constants Declarations */
+
+/* This many writes can be in flight at once, and buffers are given at least
+ * this many bytes of room when they're made. */
+static const size_t depth = 8;
+static const size_t buffer_size = size_t{1} << 24;
+
+/* Direct writes have to be made in whole pages, and a single write can't be
+ * bigger than the largest value of a submission queue entry's length. */
+static const size_t alignment = 4096; // bytes
+static const size_t largest = size_t{1} << 30; // bytes
+
+/* Buffers are mapped straight from the kernel to keep them page-aligned. */
+static const libSphysl::storage_t storage{
+	libSphysl::storage_t::mapped_memory, 0
+};
+
+/* Function Declarations */
+
+/* These set up and tear down an io_uring, returning false if it can't be set
+ * up, and hand a write over to the kernel, returning false if it won't take
+ * it. */
+static bool setup(libSphysl::io::uring_t& ring, unsigned entries);
+static void teardown(libSphysl::io::uring_t& ring);
+
+static bool submit(
+	libSphysl::io::uring_t& ring, int fd, uint64_t index,
+	const libSphysl::io::request_t& request
+);
+
+/* This writes everything with pwrite(), retrying short writes and returning
+ * the errno if it fails. */
+static int write_all(int fd, const char* data, size_t bytes, size_t offset);
+
+/* Function Definitions */
+
+libSphysl::io::writer_t::writer_t(const std::string& path, bool direct):
+	path{path}, direct{direct}, buffer{storage}, requests(depth)
+{
+	const auto flags = O_WRONLY | O_CREAT | O_TRUNC;
+	if(direct) this -> fd = open(path.c_str(), flags | O_DIRECT, 0644);
+
+	if(this -> fd == -1) {
+		this -> fd = open(path.c_str(), flags, 0644);
+		this -> direct = false;
+	}
+
+	if(this -> fd == -1) throw std::runtime_error(
+		"couldn't open '" + path + "' for writing: "
+		+ std::strerror(errno)
+	);
+
+	this -> buffer.reserve(buffer_size);
+	setup(this -> ring, depth);
+}
+
+libSphysl::io::writer_t::~writer_t() {
+	try {
+		this -> finish();
+	}
+
+	catch(std::exception&) {}
+}
+
+void libSphysl::io::writer_t::flush() {
+	auto& buffer = this -> buffer;
+	auto bytes = buffer.size();
+	if(this -> direct) bytes -= bytes % alignment;
+	if(!bytes) return;
+
+	/* Once something's failed, there's no point in writing anything else,
+	 * so just throw it away. */
+	if(this -> error) {}
+
+	/* Hand the buffer over to be written, keeping whatever's left of it
+	 * in a spare buffer, or a new one if they're all in flight. */
+	else {
+		libSphysl::io::buffer_t next{storage};
+
+		if(!this -> spare.empty()) {
+			next = std::move(this -> spare.back());
+			this -> spare.pop_back();
+		}
+
+		else next.reserve(buffer_size);
+
+		next.append(buffer, bytes, std::string::npos);
+		buffer.resize(bytes);
+
+		auto request = std::find_if(
+			this -> requests.begin(), this -> requests.end(),
+			[](const auto& r){ return !r.busy; }
+		);
+
+		while(request == this -> requests.end()) {
+			this -> reap(true);
+
+			request = std::find_if(
+				this -> requests.begin(),
+				this -> requests.end(),
+				[](const auto& r){ return !r.busy; }
+			);
+		}
+
+		request -> buffer = std::move(buffer);
+		request -> data = request -> buffer.data();
+		request -> bytes = bytes;
+		request -> offset = this -> offset;
+		this -> submit(request - this -> requests.begin());
+
+		buffer = std::move(next);
+		this -> offset += bytes;
+		return;
+	}
+
+	buffer.erase(0, bytes);
+	this -> offset += bytes;
+}
+
+void libSphysl::io::writer_t::write(const char* data, size_t bytes) {
+	/* Direct writes have to come from the buffer, since they have to be
+	 * aligned, so the data's copied over a buffer at a time. */
+	if(this -> direct) {
+		while(bytes) {
+			const auto n = std::min(bytes, buffer_size);
+			this -> buffer.append(data, n);
+
+			if(this -> buffer.size() >= buffer_size) {
+				this -> flush();
+			}
+
+			data += n;
+			bytes -= n;
+		}
+
+		return;
+	}
+
+	this -> flush();
+
+	/* Large writes are split up so that they can all be in flight at
+	 * once, rather than one after the other. */
+	if(!this -> error) for(size_t done = 0; done < bytes;) {
+		auto request = std::find_if(
+			this -> requests.begin(), this -> requests.end(),
+			[](const auto& r){ return !r.busy; }
+		);
+
+		if(request == this -> requests.end()) {
+			this -> reap(true); continue;
+		}
+
+		const auto n = std::min(
+			bytes - done, std::max(buffer_size, bytes / depth)
+		);
+
+		request -> data = data + done;
+		request -> bytes = n;
+		request -> offset = this -> offset + done;
+		this -> submit(request - this -> requests.begin());
+
+		done += n;
+	}
+
+	this -> offset += bytes;
+}
+
+void libSphysl::io::writer_t::finish() {
+	if(this -> fd == -1) return;
+
+	/* Direct files are padded out to a whole page, and trimmed back once
+	 * everything's been written. */
+	const auto size = this -> size();
+
+	if(this -> direct) this -> buffer.append(
+		(alignment - size % alignment) % alignment, '\0'
+	);
+
+	this -> flush();
+
+	while(std::any_of(
+		this -> requests.begin(), this -> requests.end(),
+		[](const auto& r){ return r.busy; }
+	)) this -> reap(true);
+
+	/* Let the thread know that there's nothing more to write. */
+	if(this -> thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> guard(this -> lock);
+			this -> finished = true;
+		}
+
+		this -> changed.notify_all();
+		this -> thread.join();
+	}
+
+	if(this -> direct && !this -> error && ftruncate(this -> fd, size)) {
+		this -> error = errno;
+	}
+
+	if(close(this -> fd) && !this -> error) this -> error = errno;
+	this -> fd = -1;
+
+	teardown(this -> ring);
+	this -> buffer.clear();
+	this -> spare.clear();
+
+	if(this -> error) throw std::runtime_error(
+		"couldn't write '" + this -> path + "': "
+		+ std::strerror(this -> error)
+	);
+}
+
+void libSphysl::io::writer_t::reap(bool wait) {
+	/* Buffers that have been written can be reused. */
+	const auto release = [&](libSphysl::io::request_t& request) {
+		request.busy = false;
+		request.queued = false;
+
+		if(!request.buffer.empty()) {
+			request.buffer.clear();
+			this -> spare.push_back(std::move(request.buffer));
+			request.buffer = libSphysl::io::buffer_t{storage};
+		}
+	};
+
+	/* We can only wait for the thread if none of the writes are with the
+	 * kernel, since we'd never hear back from it otherwise. */
+	auto kernel = false, thread = false;
+
+	for(const auto& i: this -> requests) {
+		if(i.busy && i.queued) thread = true;
+		else if(i.busy) kernel = true;
+	}
+
+	if(thread) {
+		std::unique_lock<std::mutex> guard(this -> lock);
+
+		if(wait && !kernel) this -> changed.wait(guard, [&]{
+			return !this -> done.empty();
+		});
+
+		for(const auto& [index, error]: this -> done) {
+			if(error && !this -> error) this -> error = error;
+			release(this -> requests[index]);
+		}
+
+		if(!this -> done.empty()) wait = false;
+		this -> done.clear();
+	}
+
+	if(!kernel) return;
+
+	auto& ring = this -> ring;
+	auto head = *ring.cq_head;
+
+	/* Wait for the kernel to finish something if it hasn't yet. */
+	if(wait && head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+		syscall(
+			__NR_io_uring_enter, ring.fd, 0, 1,
+			IORING_ENTER_GETEVENTS, nullptr, 0
+		);
+	}
+
+	while(head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+		const auto& cqe = ring.cqes[head & *ring.cq_mask];
+		const auto index = cqe.user_data;
+		auto& request = this -> requests[index];
+		const auto result = cqe.res;
+		head++;
+
+		/* Short writes and interruptions are carried on with, and
+		 * anything else is a failure. */
+		if(result == -EINTR || result == -EAGAIN) {}
+
+		else if(result < 0) {
+			if(!this -> error) this -> error = -result;
+			request.bytes = 0;
+		}
+
+		else {
+			request.data += result;
+			request.bytes -= result;
+			request.offset += result;
+		}
+
+		if(result == 0) {
+			if(!this -> error) this -> error = EIO;
+			request.bytes = 0;
+		}
+
+		if(request.bytes && !this -> error) this -> submit(index);
+		else release(request);
+	}
+
+	__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+}
+
+void libSphysl::io::writer_t::submit(size_t index) {
+	auto& request = this -> requests[index];
+	request.busy = true;
+
+	if(this -> ring.fd != -1 && ::submit(
+		this -> ring, this -> fd, index, request
+	)) return;
+
+	/* Otherwise, it's written on the thread, so that we don't have to wait
+	 * for it here. */
+	if(!this -> thread.joinable()) {
+		this -> thread = std::thread(&writer_t::kernel, this);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(this -> lock);
+		request.queued = true;
+		this -> queue.push_back(index);
+	}
+
+	this -> changed.notify_all();
+}
+
+void libSphysl::io::writer_t::kernel() {
+	std::unique_lock<std::mutex> guard(this -> lock);
+
+	while(true) {
+		this -> changed.wait(guard, [&]{
+			return !this -> queue.empty() || this -> finished;
+		});
+
+		if(this -> queue.empty()) return;
+
+		/* The request isn't touched by anyone else until we hand it
+		 * back, so we don't need the lock while writing it. */
+		const auto index = this -> queue.front();
+		const auto& request = this -> requests[index];
+		this -> queue.pop_front();
+
+		guard.unlock();
+
+		const auto error = write_all(
+			this -> fd, request.data, request.bytes, request.offset
+		);
+
+		guard.lock();
+
+		this -> done.emplace_back(index, error);
+		this -> changed.notify_all();
+	}
+}
+
+static bool setup(libSphysl::io::uring_t& ring, unsigned entries) {
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = 2 * entries;
+
+	ring.fd = syscall(__NR_io_uring_setup, entries, &params);
+	if(ring.fd == -1) return false;
+
+	/* Kernels older than 5.4 need the queues to be mapped separately, and
+	 * they're old enough that we just fall back to pwrite() instead. */
+	if(!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+		teardown(ring); return false;
+	}
+
+	/* IORING_OP_WRITE only came in with 5.6, as did probing for it, so any
+	 * kernel that can't tell us it has it doesn't. */
+	const unsigned ops = IORING_OP_WRITE + 1;
+
+	std::vector<char> memory(
+		sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op)
+	);
+
+	const auto probe = reinterpret_cast<io_uring_probe*>(memory.data());
+
+	if(syscall(
+		__NR_io_uring_register, ring.fd, IORING_REGISTER_PROBE,
+		probe, ops
+	) == -1 || probe -> last_op < IORING_OP_WRITE || !(
+		probe -> ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED
+	)) {
+		teardown(ring); return false;
+	}
+
+	ring.rings_size = std::max(
+		params.sq_off.array + params.sq_entries * sizeof(unsigned),
+		params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe)
+	);
+
+	ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+	ring.rings = mmap(
+		nullptr, ring.rings_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING
+	);
+
+	auto sqes = mmap(
+		nullptr, ring.sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES
+	);
+
+	if(ring.rings == MAP_FAILED) ring.rings = nullptr;
+	if(sqes != MAP_FAILED) ring.sqes = static_cast<io_uring_sqe*>(sqes);
+
+	if(!ring.rings || !ring.sqes) {
+		teardown(ring); return false;
+	}
+
+	const auto rings = static_cast<char*>(ring.rings);
+	const auto field = [&](unsigned offset) {
+		return reinterpret_cast<unsigned*>(rings + offset);
+	};
+
+	ring.sq_head = field(params.sq_off.head);
+	ring.sq_tail = field(params.sq_off.tail);
+	ring.sq_mask = field(params.sq_off.ring_mask);
+	ring.sq_array = field(params.sq_off.array);
+
+	ring.cq_head = field(params.cq_off.head);
+	ring.cq_tail = field(params.cq_off.tail);
+	ring.cq_mask = field(params.cq_off.ring_mask);
+
+	ring.cqes = reinterpret_cast<io_uring_cqe*>(
+		rings + params.cq_off.cqes
+	);
+
+	return true;
+}
+
+static void teardown(libSphysl::io::uring_t& ring) {
+	if(ring.sqes) munmap(ring.sqes, ring.sqes_size);
+	if(ring.rings) munmap(ring.rings, ring.rings_size);
+	if(ring.fd != -1) close(ring.fd);
+
+	ring = libSphysl::io::uring_t{};
+}
+
+static bool submit(
+	libSphysl::io::uring_t& ring, int fd, uint64_t index,
+	const libSphysl::io::request_t& request
+){
+	/* We're the only ones adding entries, and there are never more in
+	 * flight than there's room for, so the tail is ours to move. */
+	const auto tail = *ring.sq_tail;
+	const auto slot = tail & *ring.sq_mask;
+
+	auto& sqe = ring.sqes[slot];
+	std::memset(&sqe, 0, sizeof(sqe));
+
+	sqe.opcode = IORING_OP_WRITE;
+	sqe.fd = fd;
+	sqe.addr = reinterpret_cast<uint64_t>(request.data);
+	sqe.len = std::min(request.bytes, largest);
+	sqe.off = request.offset;
+	sqe.user_data = index;
+
+	ring.sq_array[slot] = slot;
+	__atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	long result;
+
+	do result = syscall(__NR_io_uring_enter, ring.fd, 1, 0, 0, nullptr, 0);
+	while(result == -1 && errno == EINTR);
+
+	/* If the kernel didn't take the entry, such as when it's short of
+	 * memory (EAGAIN) or its completion queue is full (EBUSY), we take it
+	 * back, since it would otherwise be left there for good. */
+	if(result == 1) return true;
+	if(__atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) != tail) return true;
+
+	__atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+	return false;
+}
+
+static int write_all(int fd, const char* data, size_t bytes, size_t offset) {
+	while(bytes) {
+		const auto written = pwrite(fd, data, bytes, offset);
+
+		if(written == -1) {
+			if(errno == EINTR) continue;
+			return errno;
+		}
+
+		data += written;
+		bytes -= written;
+		offset += written;
+	}
+
+	return 0;
+}
@@ -13,6 +13,10 @@
  * You should have received a copy of the GNU General Public License along with
  * this program. If not, see <https://www.gnu.org/licenses/>. */
 
+/* Including Standard Libraries */
+
+#include <stdexcept>
+
 /* Including Library Headerfiles */
 
 #include <libSphysl.h>
@@ -31,6 +35,9 @@ libSphysl::workset_t::workset_t(
 	const auto concurrency = this -> threads.size();
 	const auto total = e.args.size();
 
+	/* If there's nothing to calculate, there's nothing to list. */
+	if(!total) return;
+
 	const auto num_threads = total > concurrency? concurrency: total;
 	// Can't use more threads than there are calculations.
 
@@ -93,35 +100,26 @@ void libSphysl::workset_t::run() {
 	/* Load the listing for each thread and signal to start execution. */
 	auto it = start;
 	for(auto& i: this -> listings) {
-		it -> listing = &i;
-		it -> start.unlock();
+		{
+			std::lock_guard<std::mutex> guard(it -> lock);
+			it -> listing = &i;
+			it -> running = true;
+		}
 
+		it -> changed.notify_all();
 		std::advance(it, 1);
 	}
 
-	/* Once all the threads are running, come back and relock the start
-	 * mutex so that they stop once they're done with the listing. */
+	/* Now we wait for each of the threads to finish up their work, which
+	 * they signal by clearing the flag we set. */
 	it = start;
 	for(const auto& i: this -> listings) {
 		(void) i;
 		// This use of the iterators in these loops may seem weird but
 		// is necessary as there may be fewer listings than threads.
 
-		it -> start.lock();
-
-		std::advance(it, 1);
-	}
-
-	/* Now we wait for the threads to finish up their work by trying to
-	 * lock the stop mutex, which blocks until the thread unlocks it first.
-	 * We then unlock the mutex so that the thread can reset, ready for the
-	 * next workset. */
-	it = start;
-	for(const auto& i: this -> listings) {
-		(void) i;
-
-		it -> stop.lock();
-		it -> stop.unlock();
+		std::unique_lock<std::mutex> guard(it -> lock);
+		it -> changed.wait(guard, [&]{ return !it -> running; });
 
 		std::advance(it, 1);
 	}
@@ -167,20 +165,21 @@ static void helper_kernel(libSphysl::thread_t* t) {
 	/* For a full run-down on the way the threads are coordinated, please
 	 * refer to the file <docs/thread_synchronisation.md>. */
 
-	/* Try to lock the start mutex which is unlocked as a signal to start
-	 * calculations. Then unlock it and lock the stop mutex to indicate
-	 * we aren't done executing code. */
-loop:	t -> start.lock();
-	t -> stop.lock();
-	t -> start.unlock();
+	std::unique_lock<std::mutex> guard(t -> lock);
+
+	/* Wait to be given a listing, and then run the calculator on the
+	 * arguments for all the calculations without holding the lock. */
+loop:	t -> changed.wait(guard, [&]{ return t -> running; });
+	guard.unlock();
 
-	/* Run the calculator on the arguments for all the calculations. */
 	for(auto& i: t -> listing -> second) {
 		t -> listing -> first(i);
 	}
 
 	/* Signal that we are done with code execution. */
-	t -> stop.unlock();
+	guard.lock();
+	t -> running = false;
+	t -> changed.notify_all();
 
 	/* Break out if we need to stop, else go back to the top and wait to
 	 * start doing calculations again. */
@@ -192,12 +191,30 @@ loop:	t -> start.lock();
  * worksets. The main reason it exists is so that sandbox_t::start() can return
  * to whichever function caled it. */
 
+static void run_tasks(libSphysl::sandbox_t *s) {
+	/* Take the pending tasks out of the sandbox so that the lock isn't
+	 * held while they run, since they may well schedule more tasks. */
+	s -> tasks_lock.lock();
+	auto tasks = std::move(s -> tasks);
+	s -> tasks.clear();
+	s -> tasks_lock.unlock();
+
+	/* Run them in the order they were scheduled. */
+	for(auto& i: tasks) {
+		i(s);
+	}
+}
+
 static void main_kernel(libSphysl::sandbox_t *s) {
 	/* Keep running all the worksets until we're done. */
 	while(!s -> finished) {
 		for(auto& i: s -> worksets) {
 			i.run();
 		}
+
+		/* No worksets are running now, so it's safe to run any tasks
+		 * that were scheduled while we were going through them. */
+		run_tasks(s);
 	}
 }
 
@@ -211,7 +228,7 @@ void libSphysl::sandbox_t::start() {
 		 * it doesn't actually start doing anything until the first
 		 * workset gets run. */
 		i.finished = false;
-		i.start.lock();
+		i.running = false;
 
 		/* Start the thread. */
 		i.thread = std::thread{helper_kernel, &i};
@@ -245,16 +262,97 @@ void libSphysl::sandbox_t::stop() {
 			std::vector<void*>{}
 		};
 
-		i.listing = &listing;
-
 		/* Tell them to finish up when they're done. */
-		i.finished = true;
+		{
+			std::lock_guard<std::mutex> guard(i.lock);
+			i.listing = &listing;
+			i.finished = true;
+			i.running = true;
+		}
 
 		/* Start them off and wait for them to finish and exit
 		 * normally. */
-		i.start.unlock();
+		i.changed.notify_all();
 		i.thread.join();
 	}
+
+	/* Run whatever tasks were scheduled after the last run through the
+	 * worksets. */
+	run_tasks(this);
+}
+
+void libSphysl::sandbox_t::schedule(const task_t& task) {
+	/* If the simulation isn't running, nothing can get in the way, so we
+	 * just run the task. */
+	if(!this -> main_thread.joinable()) {
+		task(this);
+		return;
+	}
+
+	/* Otherwise, leave it for the main thread. */
+	this -> tasks_lock.lock();
+	this -> tasks.push_back(task);
+	this -> tasks_lock.unlock();
+}
+
+/* This does the actual regenerating for sandbox_t::regenerate(). */
+static void regenerate_engines(libSphysl::sandbox_t* s);
+
+void libSphysl::sandbox_t::regenerate() {
+	/* If we're already regenerating, just make sure we go again. */
+	if(this -> regenerating) {
+		this -> stale = true;
+		return;
+	}
+
+	this -> regenerating = true;
+
+	do {
+		this -> stale = false;
+		regenerate_engines(this);
+	} while(this -> stale);
+
+	this -> regenerating = false;
+}
+
+static void regenerate_engines(libSphysl::sandbox_t* s) {
+	/* The engines we'll be replacing the current list with. */
+	std::list<libSphysl::engine_t> engines{};
+
+	/* Go through the engines, keeping the ones we can't regenerate and
+	 * replacing the ones we can. */
+	auto it = s -> engines.begin();
+
+	while(it != s -> engines.end()) {
+		if(!it -> generator) {
+			engines.push_back(*it);
+			std::advance(it, 1);
+			continue;
+		}
+
+		/* Cache the generator, since the engine holding it is about to
+		 * be destroyed along with the rest it generated. */
+		const auto generator = it -> generator;
+		const auto span = it -> span;
+
+		for(size_t i = 0; i < span; i++, std::advance(it, 1)) {
+			it -> destructor(&*it);
+		}
+
+		/* Generate the replacements and put them in the same place. */
+		auto replacements = generator(s);
+		engines.splice(engines.end(), replacements);
+	}
+
+	s -> engines = engines;
+
+	/* The worksets are one per engine and in the same order, so we can
+	 * simply rebuild all of them. */
+	s -> worksets.clear();
+
+	for(const auto& i: s -> engines) {
+		s -> worksets.push_back(libSphysl::workset_t(s, i));
+	}
 }
 
 libSphysl::data_t&
@@ -276,12 +374,12 @@ libSphysl::sandbox_t::config_get(const std::string& id) {
 template<typename T>
 static bool init(
 	libSphysl::data_vector_t& vec, const size_t total,
-	const libSphysl::data_t& val
+	const libSphysl::storage_t& storage, const libSphysl::data_t& val
 ){
 	/* If the type matches for the value, set the values and return true
 	 * else return false. */
 	if(std::holds_alternative<T>(val)) {
-		vec = std::vector<T>(total, std::get<T>(val));
+		vec = libSphysl::column_t<T>(total, std::get<T>(val), storage);
 		return true;
 	}
 
@@ -291,22 +389,23 @@ static bool init(
 template<typename T>
 static bool init(
 	libSphysl::data_vector_t& vec, const size_t total,
+	const libSphysl::storage_t& storage,
 	const libSphysl::data_t& min, const libSphysl::data_t& max,
 	const libSphysl::data_t& val
 ){
 	/* If the type matches for the value, set the values and return true. */
 	if(std::holds_alternative<T>(val)) {
-		vec = std::vector<T>(total, std::get<T>(val));
+		vec = libSphysl::column_t<T>(total, std::get<T>(val), storage);
 		return true;
 	}
 
 	/* If the type matches for the range, randomise the values accordingly
 	 * and return true, else return false. */
 	if(std::holds_alternative<T>(min)) {
-		vec = std::vector<T>(total); // Initialise the vector
+		vec = libSphysl::column_t<T>(total, storage); // Initialise it.
 
 		libSphysl::utility::randomise(
-			std::get<std::vector<T>>(vec),
+			std::get<libSphysl::column_t<T>>(vec),
 			std::get<T>(min), std::get<T>(max)
 		); // Randomise the values.
 
@@ -316,27 +415,41 @@ static bool init(
 	return false;
 }
 
-libSphysl::data_vector_t&
-libSphysl::sandbox_t::database_get(const std::string& id) {
-	/* We need to know how many entities there are in the system, as that
-	 * determines the number of rows in the database if we need to insert
-	 * another column. */
-	const auto total = std::get<size_t>(
-		this -> config_get("entity count")
-	);
+/* This creates a column of <total> rows which are all set to the given value,
+ * or doubles set to 0.0 if there's no column type for the value. */
 
-	/* If the entry exists in the database, return it. */
-	try {return this -> database.at(id);}
-	catch(const std::out_of_range &e) {(void) e;}
+static libSphysl::data_vector_t uniform_column(
+	const libSphysl::data_t& val, const size_t total,
+	const libSphysl::storage_t& storage
+){
+	/* Try every type until we find the one the value has. */
+	libSphysl::data_vector_t vec;
+	const auto& s = storage;
+
+	if(init                 <bool> (vec, total, s, val)) return vec;
+	if(init               <size_t> (vec, total, s, val)) return vec;
+	if(init        <std::intmax_t> (vec, total, s, val)) return vec;
+	if(init               <double> (vec, total, s, val)) return vec;
+	if(init <std::complex<double>> (vec, total, s, val)) return vec;
 
+	return libSphysl::column_t<double>(total, storage);
+}
+
+/* This creates a column of <total> rows for the given id, filled in with the
+ * default values or randomised within the default ranges for it. */
+
+static libSphysl::data_vector_t new_column(
+	const std::string& id, const size_t total,
+	const libSphysl::storage_t& storage
+){
 	/* We'll try getting the defaults config data, but the maps may throw
 	 * if the defaults are not configured. */
 
 	/* By setting the default values to binary_t's, if the defaults aren't
 	 * configured and they don't get updated, we'll hit the end of the
 	 * function and know to throw an error. */
-	data_t value = libSphysl::binary_t{};
-	data_pair_t range = std::pair<
+	libSphysl::data_t value = libSphysl::binary_t{};
+	libSphysl::data_pair_t range = std::pair<
 		libSphysl::binary_t, libSphysl::binary_t
 	>{};
 
@@ -349,18 +462,338 @@ libSphysl::sandbox_t::database_get(const std::string& id) {
 	/* Get the start and end of the ranges. */
 	const auto& min = range.first, max = range.second, val = value;
 
-	/* Insert an unitialised variant of vectors into the database and grab
-	 * a reference to it. */
-	auto& vec = this -> database[id];
+	/* Create an unitialised variant of vectors. */
+	libSphysl::data_vector_t vec;
+	const auto& s = storage;
+	const auto& n = total;
 
 	/* Try to set the values for every type we support, if nothing matches
 	 * the type of the default value, assume there were no default values
 	 * and return with a default-initialised vector of doubles. */
-	if(init                 <bool> (vec, total,           val)) return vec;
-	if(init               <size_t> (vec, total, min, max, val)) return vec;
-	if(init        <std::intmax_t> (vec, total, min, max, val)) return vec;
-	if(init               <double> (vec, total, min, max, val)) return vec;
-	if(init <std::complex<double>> (vec, total,           val)) return vec;
+	if(init                 <bool> (vec, n, s,           val)) return vec;
+	if(init               <size_t> (vec, n, s, min, max, val)) return vec;
+	if(init        <std::intmax_t> (vec, n, s, min, max, val)) return vec;
+	if(init               <double> (vec, n, s, min, max, val)) return vec;
+	if(init <std::complex<double>> (vec, n, s,           val)) return vec;
+
+	return libSphysl::column_t<double>(total, storage);
+}
+
+libSphysl::data_vector_t&
+libSphysl::sandbox_t::database_get(const std::string& id) {
+	/* We need to know how many entities there are in the system, as that
+	 * determines the number of rows in the database if we need to insert
+	 * another column. */
+	const auto total = std::get<size_t>(
+		this -> config_get("entity count")
+	);
+
+	/* Per-axis aliases of packed columns can't be returned as vectors. */
+	if(this -> axes.count(id)) throw std::invalid_argument(
+		"libSphysl: '" + id + "' is packed into '"
+		+ this -> axes.at(id).first + "'"
+	);
+
+	/* If the entry exists in the database, return it. */
+	try {return this -> database.at(id);}
+	catch(const std::out_of_range &e) {(void) e;}
+
+	/* If the column was uniform, materialise it with its value, and make
+	 * sure the engines stop using the value. */
+	if(this -> uniforms.count(id)) {
+		this -> database[id] = uniform_column(
+			this -> uniforms.at(id), total, this -> storage
+		);
+
+		this -> uniforms.erase(id);
+		this -> regenerate();
+
+		return this -> database.at(id);
+	}
+
+	/* Otherwise, insert a new column with the default values. */
+	return this -> database[id] = new_column(id, total, this -> storage);
+}
+
+bool libSphysl::sandbox_t::database_uniform(const std::string& id) const{
+	/* Columns that have been materialised aren't uniform anymore. */
+	if(this -> database.count(id) || this -> axes.count(id)) return false;
+	if(this -> uniforms.count(id)) return true;
+
+	/* Otherwise, it depends on whether the defaults would make it so. */
+	return libSphysl::default_entry_values.count(id)
+		&& !libSphysl::default_entry_ranges.count(id);
+}
+
+libSphysl::data_t&
+libSphysl::sandbox_t::uniform_get(const std::string& id) {
+	/* If the value is already there, return it. */
+	try {return this -> uniforms.at(id);}
+	catch(const std::out_of_range &e) {(void) e;}
+
+	/* Insert the default value and return it. Note that this will throw
+	 * if the id is not in the default entry values. */
+	return this -> uniforms[id] = libSphysl::default_entry_values.at(id);
+}
+
+void libSphysl::sandbox_t::database_pack(const std::string& id) {
+	/* If the column is already packed, there's nothing to do. */
+	if(this -> database.count(id)) {
+		if(std::holds_alternative<column_t<vec3_t>>(
+			this -> database.at(id)
+		)) return;
+	}
+
+	/* Get the per-axis columns, which will be created from the defaults
+	 * if they don't exist yet. */
+	const auto& xs = std::get<column_t<double>>(
+		this -> database_get("x " + id)
+	);
+
+	const auto& ys = std::get<column_t<double>>(
+		this -> database_get("y " + id)
+	);
+
+	const auto& zs = std::get<column_t<double>>(
+		this -> database_get("z " + id)
+	);
+
+	/* Interleave the values into the packed column. */
+	column_t<vec3_t> packed(xs.size(), this -> storage);
+
+	for(size_t i = 0; i < packed.size(); i++) {
+		packed[i] = {xs[i], ys[i], zs[i]};
+	}
+
+	/* Swap the per-axis columns out for the packed one, and remember
+	 * which component of it each of the old names refers to. */
+	this -> database[id] = std::move(packed);
+
+	this -> database.erase("x " + id);
+	this -> database.erase("y " + id);
+	this -> database.erase("z " + id);
+
+	this -> axes["x " + id] = {id, 0};
+	this -> axes["y " + id] = {id, 1};
+	this -> axes["z " + id] = {id, 2};
+}
+
+/* This adds the "entity id" column to the database if it isn't there yet,
+ * giving every entity its current row as its id, and returns it. */
+
+static libSphysl::column_t<size_t>& get_ids(libSphysl::sandbox_t* s) {
+	if(!s -> database.count("entity id")) {
+		const auto total = std::get<size_t>(
+			s -> config_get("entity count")
+		);
+
+		libSphysl::column_t<size_t> ids(total, s -> storage);
+
+		for(size_t i = 0; i < total; i++) {
+			ids[i] = i;
+		}
+
+		/* Every entity is where it started off, so the rows are the
+		 * same as the ids. */
+		s -> rows.assign(ids.begin(), ids.end());
+		s -> database["entity id"] = std::move(ids);
+	}
+
+	return std::get<libSphysl::column_t<size_t>>(
+		s -> database.at("entity id")
+	);
+}
+
+/* This rebuilds sandbox_t::rows from the "entity id" column. Rows of entities
+ * that have been removed are set to SIZE_MAX. */
+
+static void map_rows(libSphysl::sandbox_t* s) {
+	const auto& ids = get_ids(s);
+
+	for(auto& i: s -> rows) {
+		i = SIZE_MAX;
+	}
+
+	for(size_t i = 0; i < ids.size(); i++) {
+		s -> rows[ids[i]] = i;
+	}
+}
+
+void libSphysl::sandbox_t::database_reorder(const std::vector<size_t>& order) {
+	/* Make sure the order is a permutation of the rows before touching
+	 * any of the columns. */
+	const auto total = std::get<size_t>(
+		this -> config_get("entity count")
+	);
+
+	if(order.size() != total) throw std::invalid_argument(
+		"libSphysl: the order has " + std::to_string(order.size())
+		+ " rows, but there are " + std::to_string(total) + " entities"
+	);
+
+	std::vector<bool> seen(total, false);
+
+	for(const auto& i: order) {
+		if(i >= total || seen[i]) throw std::invalid_argument(
+			"libSphysl: the order isn't a permutation of the rows"
+		);
+
+		seen[i] = true;
+	}
+
+	/* If this is the first reordering, add the entity ids so that the
+	 * entities can still be found afterwards. */
+	get_ids(this);
+
+	/* Permute every column through a copy on the heap, writing the values
+	 * back into the original vector so that it isn't reallocated. The
+	 * copy doesn't take the column's allocator, which could otherwise map
+	 * another file for it. */
+	for(auto& i: this -> database) {
+		std::visit([&](auto& column) {
+			typedef typename std::decay_t<
+				decltype(column)
+			>::value_type T;
+
+			const std::vector<T> copy(column.begin(), column.end());
+
+			for(size_t j = 0; j < order.size(); j++) {
+				column[j] = copy[order[j]];
+			}
+		}, i.second);
+	}
+
+	/* Rebuild the mapping from entity ids to rows. */
+	map_rows(this);
+
+	/* The engines' arguments are now pointing at the wrong entities. */
+	this -> regenerate();
+}
+
+/* This appends <count> rows with the default values for the given id onto the
+ * end of a column. */
+
+static void grow_column(
+	const std::string& id, libSphysl::data_vector_t& column,
+	const size_t count, const libSphysl::storage_t& storage
+){
+	/* Packed columns get the defaults for their axes. */
+	libSphysl::data_vector_t extra;
+
+	if(std::holds_alternative<libSphysl::column_t<libSphysl::vec3_t>>(
+		column
+	)) {
+		const auto xs = new_column("x " + id, count, {});
+		const auto ys = new_column("y " + id, count, {});
+		const auto zs = new_column("z " + id, count, {});
+
+		libSphysl::column_t<libSphysl::vec3_t> vec3s(count, storage);
+
+		for(size_t i = 0; i < count; i++) vec3s[i] = {
+			std::get<libSphysl::column_t<double>>(xs)[i],
+			std::get<libSphysl::column_t<double>>(ys)[i],
+			std::get<libSphysl::column_t<double>>(zs)[i]
+		};
+
+		extra = std::move(vec3s);
+	}
+
+	else extra = new_column(id, count, storage);
+
+	/* If the defaults don't have the same type as the column, which can
+	 * happen if the column was inserted by hand, we use value-initialised
+	 * values instead. */
+	std::visit([&](auto& vec) {
+		typedef typename std::decay_t<decltype(vec)>::value_type T;
+
+		if(std::holds_alternative<libSphysl::column_t<T>>(extra)) {
+			const auto& values = std::get<
+				libSphysl::column_t<T>
+			>(extra);
+
+			vec.insert(vec.end(), values.begin(), values.end());
+		}
+
+		else vec.resize(vec.size() + count);
+	}, column);
+}
+
+void libSphysl::sandbox_t::add_entities(size_t count) {
+	this -> schedule([count](libSphysl::sandbox_t* s) {
+		/* The new entities get the ids after the last one we handed
+		 * out, which is also where the rows for them are going to be
+		 * put in the database. */
+		auto& ids = get_ids(s);
+		auto& total = std::get<size_t>(
+			s -> config_get("entity count")
+		);
+
+		for(size_t i = 0; i < count; i++) {
+			ids.push_back(s -> rows.size());
+			s -> rows.push_back(total + i);
+		}
+
+		/* Grow every other column with its default values. */
+		for(auto& [id, column]: s -> database) {
+			if(id == "entity id") continue;
+			grow_column(id, column, count, s -> storage);
+		}
+
+		/* The columns have probably been reallocated, so the engines
+		 * need to be regenerated. */
+		total += count;
+		s -> regenerate();
+	});
+}
+
+void libSphysl::sandbox_t::remove_entities(const std::vector<size_t>& ids) {
+	this -> schedule([ids](libSphysl::sandbox_t* s) {
+		/* Mark the rows we are getting rid of. */
+		get_ids(s);
+
+		const auto total = std::get<size_t>(
+			s -> config_get("entity count")
+		);
+
+		std::vector<bool> removed(total, false);
+
+		/* Ids that were never handed out are skipped, the same as
+		 * those of entities that were removed already. */
+		for(const auto& i: ids) {
+			if(i >= s -> rows.size()) continue;
+
+			const auto row = s -> entity_row(i);
+			if(row != SIZE_MAX) removed[row] = true;
+		}
+
+		/* Compact every column by moving the rows we're keeping down
+		 * into the gaps, keeping them in the same order. */
+		size_t remaining = 0;
+
+		for(auto& i: s -> database) {
+			std::visit([&](auto& vec) {
+				size_t k = 0;
+
+				for(size_t j = 0; j < total; j++) {
+					if(!removed[j]) vec[k++] = vec[j];
+				}
+
+				vec.resize(k);
+				remaining = k;
+			}, i.second);
+		}
+
+		/* Update the entity count and the mapping to the rows. */
+		s -> config_get("entity count") = remaining;
+		map_rows(s);
+
+		/* The engines were cached for the old number of entities. */
+		s -> regenerate();
+	});
+}
 
-	return vec = std::vector<double>(total);
+size_t libSphysl::sandbox_t::entity_row(size_t id) const{
+	/* If the database has never been reordered, ids are rows. */
+	if(this -> rows.empty()) return id;
+	else return this -> rows.at(id);
 }
\ No newline at end of file
@@ -0,0 +1,578 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <cmath>
+#include <complex>
+#include <memory>
+#include <stdexcept>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl/gravity.h>
+#include <libSphysl/utility.h>
+
+/* Structure Declarations */
+
+/* Every source file has its own arg_t, so they're kept in an anonymous
+ * namespace to stop the linker from merging their destructor<arg_t>'s. */
+namespace {
+
+/* This is everything the stages of a tick share. The mesh is a cube of n^3
+ * cells, stored with z changing fastest, then y, then x, and the cells are
+ * complex so that they can be transformed in place. */
+struct mesh_t {
+	const double& G; // The gravitational constant.
+	const double& L; // The side of the box.
+
+	const size_t total; // Number of entities.
+	const size_t n; // Number of cells along each side.
+
+	libSphysl::utility::slice_t<double> m, x, y, z;
+	libSphysl::utility::slice_t<double> F_x, F_y, F_z;
+
+	/* The ranges of entities, of planes of cells along x and of lines of
+	 * cells along any one axis that each thread handles. */
+	std::vector<std::pair<size_t, size_t>> bodies, planes, lines;
+
+	/* The number of entities in each range whose cells start in each
+	 * plane, which then become where they go in the order; and the
+	 * entities sorted by that plane, with where each plane starts. */
+	std::vector<size_t> counts;
+	std::vector<size_t> order, starts;
+
+	std::vector<std::complex<double>> cells;
+	std::vector<libSphysl::vec3_t> fields; // The field at each cell.
+
+	/* The twiddle factors for the transforms each way and the bit-reversed
+	 * indices, and the square of the wave number along an axis at each
+	 * index, in units of 2 pi / L. */
+	std::vector<std::complex<double>> forwards, inverses;
+	std::vector<size_t> reversed;
+	std::vector<double> waves;
+};
+
+/* There's one of these for every thread in every stage, and the stages that
+ * can't be split up just have the one. */
+struct arg_t {
+	std::shared_ptr<mesh_t> mesh;
+	size_t range; // Index of our range in the mesh's ranges.
+
+	/* Room for the line of cells that's being transformed. */
+	std::vector<std::complex<double>> line;
+};
+
+}
+
+/* Constants Declarations */
+
+static const double pi = 3.14159265358979323846;
+
+/* Function Declarations */
+
+/* These are the calculators for each stage, in the order that they run. The
+ * transforms go along z, then y, then x, where the potential is worked out
+ * before going back the other way. */
+static void binner(void* arg);
+static void sorter(void* arg);
+static void scatterer(void* arg);
+static void depositor(void* arg);
+
+template<size_t axis, bool inverse> static void transformer(void* arg);
+static void solver(void* arg);
+
+static void differ(void* arg);
+static void interpolator(void* arg);
+
+/* This works out the cell that a position is in along an axis, counting
+ * from the one whose middle is just below it, and how far past that middle it
+ * is, as a fraction of a cell. */
+static void locate(const mesh_t& mesh, double v, size_t& i, double& f);
+
+/* This transforms the line of cells in our scratch space in place. */
+static void transform(arg_t& data, bool inverse);
+
+/* Function Definitions */
+
+std::list<libSphysl::engine_t> libSphysl::gravity::particle_mesh(
+	libSphysl::sandbox_t* s
+){
+	/* Get the variables we need from the config. */
+	const auto total = std::get<size_t>(s -> config_get("entity count"));
+	const auto threads = s -> threads.size(); // Not stored in config.
+
+	const auto& G = std::get<double>(
+		s -> config_get("gravitational constant")
+	);
+
+	const auto& L = std::get<double>(s -> config_get("box size"));
+	const auto n = std::get<size_t>(s -> config_get("mesh size"));
+
+	/* The transforms only work on powers of two, and the gradients need
+	 * two cells on either side. */
+	if(n < 4 || (n & (n - 1))) throw std::invalid_argument(
+		"the mesh size must be a power of two, at least 4"
+	);
+
+	/* Get the variables we need from the database, slicing a uniform
+	 * mass with a stride of 0. */
+	const auto masses = [&]() {
+		if(s -> database_uniform("mass")) {
+			auto& m = std::get<double>(s -> uniform_get("mass"));
+			return libSphysl::utility::slice_t<double>(
+				&m, 0, 0, total
+			);
+		}
+
+		return libSphysl::utility::slice_t<double>(
+			std::get<libSphysl::column_t<double>>(
+				s -> database_get("mass")
+			), 0, total
+		);
+	}();
+
+	const auto get_axis = [&](const std::string& id) {
+		return libSphysl::utility::get_axis(s, id, 0, total);
+	};
+
+	auto mesh = std::make_shared<mesh_t>(mesh_t{
+		G, L, total, n, masses,
+
+		get_axis("x position"),
+		get_axis("y position"),
+		get_axis("z position"),
+
+		get_axis("x force"),
+		get_axis("y force"),
+		get_axis("z force"),
+
+		{}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}
+	});
+
+	/* Give each thread its own range of everything. */
+	const auto divide = [&](
+		std::vector<std::pair<size_t, size_t>>& ranges, size_t size
+	){
+		for(const auto& range: libSphysl::utility::divide_range(
+			0, size, threads
+		)) if(range.first != range.second) ranges.push_back(range);
+	};
+
+	divide(mesh -> bodies, total);
+	divide(mesh -> planes, n);
+	divide(mesh -> lines, n * n);
+
+	mesh -> counts.resize(mesh -> bodies.size() * n);
+	mesh -> order.resize(total);
+	mesh -> starts.resize(n + 1);
+
+	mesh -> cells.resize(n * n * n);
+	mesh -> fields.resize(n * n * n);
+
+	/* Work out the tables for the transforms and the solver. */
+	size_t bits = 0;
+	while((size_t{1} << bits) < n) bits++;
+
+	for(size_t i = 0; i < n; i++) {
+		if(i < n / 2) {
+			const auto w = std::polar(1.0, -2.0 * pi * i / n);
+
+			mesh -> forwards.push_back(w);
+			mesh -> inverses.push_back(std::conj(w));
+		}
+
+		size_t r = 0;
+
+		for(size_t b = 0; b < bits; b++) {
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+
+		mesh -> reversed.push_back(r);
+
+		/* Indices past the middle are negative wave numbers. */
+		const auto k = i < n / 2? double(i): double(i) - double(n);
+		mesh -> waves.push_back(k * k);
+	}
+
+	/* Set up the engines for the stages. Each one gets an arg for every
+	 * range of whatever it works on, and the sorter just gets the one. */
+	std::list<libSphysl::engine_t> engines;
+
+	const std::vector<std::pair<void (*)(void*), size_t>> stages{
+		{binner, mesh -> bodies.size()},
+		{sorter, 1},
+		{scatterer, mesh -> bodies.size()},
+		{depositor, mesh -> planes.size()},
+
+		{transformer<2, false>, mesh -> lines.size()},
+		{transformer<1, false>, mesh -> lines.size()},
+		{solver, mesh -> lines.size()},
+		{transformer<1, true>, mesh -> lines.size()},
+		{transformer<2, true>, mesh -> lines.size()},
+
+		{differ, mesh -> planes.size()},
+		{interpolator, mesh -> bodies.size()}
+	};
+
+	for(const auto& [calculator, args]: stages) {
+		libSphysl::engine_t engine;
+
+		engine.calculator = calculator;
+		engine.destructor = libSphysl::utility::destructor<arg_t>;
+
+		for(size_t i = 0; i < args; i++) {
+			auto arg = new arg_t{
+				mesh, i, std::vector<std::complex<double>>(n)
+			};
+
+			engine.args.push_back(reinterpret_cast<void*>(arg));
+		}
+
+		engines.push_back(engine);
+	}
+
+	/* If the database is changed, we are regenerated the same way. */
+	engines.front().generator = [](libSphysl::sandbox_t* s) {
+		return libSphysl::gravity::particle_mesh(s);
+	};
+
+	engines.front().span = engines.size();
+	return engines;
+}
+
+static void binner(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& mesh = *data.mesh;
+
+	/* Count how many of our entities start in each plane. */
+	const auto [start, stop] = mesh.bodies[data.range];
+	const auto counts = mesh.counts.data() + data.range * mesh.n;
+
+	std::fill(counts, counts + mesh.n, 0);
+
+	for(size_t i = start; i < stop; i++) {
+		size_t p; double f;
+		locate(mesh, mesh.x[i], p, f);
+
+		counts[p]++;
+	}
+}
+
+static void sorter(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& mesh = *reinterpret_cast<arg_t*>(arg) -> mesh;
+
+	/* Turn the counts into where each range's entities go in each plane,
+	 * so that the entities in each plane stay in the same order as in
+	 * the database, however they're split up between the threads. */
+	const auto ranges = mesh.bodies.size();
+	size_t offset = 0;
+
+	for(size_t p = 0; p < mesh.n; p++) {
+		mesh.starts[p] = offset;
+
+		for(size_t r = 0; r < ranges; r++) {
+			const auto count = mesh.counts[r * mesh.n + p];
+			mesh.counts[r * mesh.n + p] = offset;
+			offset += count;
+		}
+	}
+
+	mesh.starts[mesh.n] = offset;
+}
+
+static void scatterer(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& mesh = *data.mesh;
+
+	/* Put each of our entities in its place in the order. */
+	const auto [start, stop] = mesh.bodies[data.range];
+	const auto offsets = mesh.counts.data() + data.range * mesh.n;
+
+	for(size_t i = start; i < stop; i++) {
+		size_t p; double f;
+		locate(mesh, mesh.x[i], p, f);
+
+		mesh.order[offsets[p]++] = i;
+	}
+}
+
+static void depositor(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& mesh = *data.mesh;
+
+	const auto n = mesh.n;
+	const auto [first, last] = mesh.planes[data.range];
+
+	const auto h = mesh.L / n;
+	const auto volume = h * h * h;
+
+	std::fill(
+		mesh.cells.begin() + first * n * n,
+		mesh.cells.begin() + last * n * n, 0.0
+	);
+
+	/* Each entity's mass is spread over the eight cells whose middles are
+	 * around it, by how close it is to each of them. We only ever write
+	 * to our own planes, so we go through the entities that start in the
+	 * plane below ours, for the top half of their mass, and then the ones
+	 * that start in each of our own. Each plane then gets its mass added
+	 * up in the same order no matter how the planes are split up. */
+	for(size_t step = 0; step <= last - first; step++) {
+		const auto p = (first + n - 1 + step) % n;
+
+		const auto below = step == 0;
+		const auto above = step == last - first;
+
+		for(auto j = mesh.starts[p]; j < mesh.starts[p + 1]; j++) {
+			const auto i = mesh.order[j];
+
+			size_t c_x, c_y, c_z;
+			double f_x, f_y, f_z;
+
+			locate(mesh, mesh.x[i], c_x, f_x);
+			locate(mesh, mesh.y[i], c_y, f_y);
+			locate(mesh, mesh.z[i], c_z, f_z);
+
+			const auto rho = mesh.m[i] / volume;
+
+			const double w_x[2]{1.0 - f_x, f_x};
+			const double w_y[2]{1.0 - f_y, f_y};
+			const double w_z[2]{1.0 - f_z, f_z};
+
+			const auto low = below? 1: 0, high = above? 1: 2;
+
+			for(auto d_x = low; d_x < high; d_x++) {
+				const auto i_x = (c_x + d_x) % n;
+
+				for(size_t d_y = 0; d_y < 2; d_y++) {
+					const auto i_y = (c_y + d_y) % n;
+					const auto row = mesh.cells.data()
+						+ (i_x * n + i_y) * n;
+
+					for(size_t d_z = 0; d_z < 2; d_z++) {
+						row[(c_z + d_z) % n] += rho
+							* w_x[d_x] * w_y[d_y]
+							* w_z[d_z];
+					}
+				}
+			}
+		}
+	}
+}
+
+template<size_t axis, bool inverse> static void transformer(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& mesh = *data.mesh;
+
+	const auto n = mesh.n;
+	const auto [first, last] = mesh.lines[data.range];
+
+	/* The lines along z are rows of the mesh, and the ones along y are
+	 * columns of a plane along x. */
+	const auto stride = axis == 2? 1: n;
+
+	for(auto l = first; l < last; l++) {
+		const auto base = axis == 2? l * n: (l / n) * n * n + l % n;
+		const auto cells = mesh.cells.data() + base;
+
+		for(size_t i = 0; i < n; i++) data.line[i] = cells[i * stride];
+		transform(data, inverse);
+		for(size_t i = 0; i < n; i++) cells[i * stride] = data.line[i];
+	}
+}
+
+static void solver(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& mesh = *data.mesh;
+
+	const auto n = mesh.n;
+	const auto [first, last] = mesh.lines[data.range];
+
+	/* In Fourier space, Poisson's equation gives the potential as -4 pi G
+	 * rho / k^2, which is divided by the n^3 that the transforms scale
+	 * everything up by as well. The mean density is left out, as it has
+	 * to be for a periodic box. The cloud-in-cell isn't deconvolved, since
+	 * that blows up the shortest waves and with them the forces between
+	 * entities a few cells apart. */
+	const auto unit = 2.0 * pi / mesh.L;
+	const auto scale = -4.0 * pi * mesh.G
+		/ (unit * unit * double(n) * double(n) * double(n));
+
+	for(auto l = first; l < last; l++) {
+		const auto i_y = l / n, i_z = l % n;
+		const auto cells = mesh.cells.data() + l;
+
+		for(size_t i = 0; i < n; i++) data.line[i] = cells[i * n * n];
+		transform(data, false);
+
+		for(size_t i_x = 0; i_x < n; i_x++) {
+			const auto k_sq = mesh.waves[i_x] + mesh.waves[i_y]
+				+ mesh.waves[i_z];
+
+			data.line[i_x] *= k_sq > 0.0? scale / k_sq: 0.0;
+		}
+
+		transform(data, true);
+		for(size_t i = 0; i < n; i++) cells[i * n * n] = data.line[i];
+	}
+}
+
+static void differ(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& mesh = *data.mesh;
+
+	const auto n = mesh.n;
+	const auto [first, last] = mesh.planes[data.range];
+
+	/* The field at each cell is minus the gradient of the potential,
+	 * by the differences across the two cells on either side. */
+	const auto h = mesh.L / n;
+	const auto potential = [&](size_t x, size_t y, size_t z) {
+		return mesh.cells[((x % n) * n + y % n) * n + z % n].real();
+	};
+
+	const auto gradient = [&](
+		size_t x, size_t y, size_t z, size_t d_x, size_t d_y, size_t d_z
+	){
+		const auto inner = potential(x + d_x, y + d_y, z + d_z)
+			- potential(x + n - d_x, y + n - d_y, z + n - d_z);
+
+		const auto outer = potential(
+			x + 2 * d_x, y + 2 * d_y, z + 2 * d_z
+		) - potential(
+			x + n - 2 * d_x, y + n - 2 * d_y, z + n - 2 * d_z
+		);
+
+		return (outer - 8.0 * inner) / (12.0 * h);
+	};
+
+	for(auto x = first; x < last; x++) {
+		for(size_t y = 0; y < n; y++) {
+			for(size_t z = 0; z < n; z++) {
+				mesh.fields[(x * n + y) * n + z] = {
+					gradient(x, y, z, 1, 0, 0),
+					gradient(x, y, z, 0, 1, 0),
+					gradient(x, y, z, 0, 0, 1)
+				};
+			}
+		}
+	}
+}
+
+static void interpolator(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& mesh = *data.mesh;
+
+	const auto n = mesh.n;
+	const auto [start, stop] = mesh.bodies[data.range];
+
+	/* Bring the field back to each entity from the same eight cells its
+	 * mass was spread over, by the same amounts. */
+	for(size_t i = start; i < stop; i++) {
+		size_t c_x, c_y, c_z;
+		double f_x, f_y, f_z;
+
+		locate(mesh, mesh.x[i], c_x, f_x);
+		locate(mesh, mesh.y[i], c_y, f_y);
+		locate(mesh, mesh.z[i], c_z, f_z);
+
+		const double w_x[2]{1.0 - f_x, f_x};
+		const double w_y[2]{1.0 - f_y, f_y};
+		const double w_z[2]{1.0 - f_z, f_z};
+
+		double g_x = 0.0, g_y = 0.0, g_z = 0.0;
+
+		for(size_t d_x = 0; d_x < 2; d_x++) {
+			for(size_t d_y = 0; d_y < 2; d_y++) {
+				for(size_t d_z = 0; d_z < 2; d_z++) {
+					const auto w = w_x[d_x] * w_y[d_y]
+						* w_z[d_z];
+
+					const auto& g = mesh.fields[(
+						((c_x + d_x) % n) * n
+						+ (c_y + d_y) % n
+					) * n + (c_z + d_z) % n];
+
+					g_x += w * g.x; g_y += w * g.y;
+					g_z += w * g.z;
+				}
+			}
+		}
+
+		mesh.F_x[i] += mesh.m[i] * g_x;
+		mesh.F_y[i] += mesh.m[i] * g_y;
+		mesh.F_z[i] += mesh.m[i] * g_z;
+	}
+}
+
+static void locate(const mesh_t& mesh, double v, size_t& i, double& f) {
+	/* The middles of the cells are half a cell in from their edges, and
+	 * everything outside of the box wraps around into it. */
+	const auto u = v * mesh.n / mesh.L - 0.5;
+	const auto floor = std::floor(u);
+
+	f = u - floor;
+
+	const auto n = static_cast<long long>(mesh.n);
+	const auto c = static_cast<long long>(floor) % n;
+
+	i = static_cast<size_t>(c < 0? c + n: c);
+}
+
+static void transform(arg_t& data, bool inverse) {
+	const auto& mesh = *data.mesh;
+	auto& line = data.line;
+
+	const auto n = mesh.n;
+
+	/* This is the radix-2 transform of Cooley and Tukey, done in place
+	 * (see footnote [1]); the values are put in bit-reversed order, and
+	 * then pairs of ever longer halves are combined. The inverse goes
+	 * the other way around the circle, and isn't scaled down. */
+	const auto& twiddles = inverse? mesh.inverses: mesh.forwards;
+
+	for(size_t i = 0; i < n; i++) {
+		const auto j = mesh.reversed[i];
+		if(i < j) std::swap(line[i], line[j]);
+	}
+
+	for(size_t half = 1; half < n; half *= 2) {
+		const auto step = n / (2 * half);
+
+		for(size_t start = 0; start < n; start += 2 * half) {
+			for(size_t k = 0; k < half; k++) {
+				const auto w = twiddles[k * step];
+
+				const auto a = line[start + k];
+				const auto b = line[start + k + half] * w;
+
+				line[start + k] = a + b;
+				line[start + k + half] = a - b;
+			}
+		}
+	}
+}
+
+/* [1] J. W. Cooley and J. W. Tukey, "An algorithm for the machine calculation
+ *     of complex Fourier series", Mathematics of Computation 19, 297 (1965). */
@@ -20,11 +20,17 @@
 
 /* Structure Declarations */
 
+/* Every source file has its own arg_t, so they're kept in an anonymous
+ * namespace to stop the linker from merging their destructor<arg_t>'s. */
+namespace {
+
 /* This is the argument that's gonig to be passed to the calculators. */
 struct arg_t {
 	const double& delta_t; // Time elapsed per simulation tick.
 	const double& c; // The speed of light.
 
+	const size_t count; // Number of entities in the slices.
+
 	libSphysl::utility::slice_t<double> m; // Masses.
 	libSphysl::utility::slice_t<double> x, y, z; // Positions.
 	libSphysl::utility::slice_t<double> v_x, v_y, v_z; // Velocities.
@@ -48,6 +54,8 @@ struct arg_t {
 	std::vector<double> coeffs; // Precomptued to avoid costly factorials.
 };
 
+}
+
 /* Function Declarations */
 
 /* This is the templated function that generates all the engines. */
@@ -61,13 +69,13 @@ static libSphysl::engine_t generator(
 
 static double& get_double(libSphysl::sandbox_t* s, const std::string& id);
 
-static std::vector<double>& get_doubles(
+static libSphysl::column_t<double>& get_doubles(
 	libSphysl::sandbox_t* s, const std::string& id
 );
 
 /* This function generates a slice_t<double> of the type we need. */
 static libSphysl::utility::slice_t<double> get_slice(
-	std::vector<double> &v, size_t start, size_t stop
+	libSphysl::column_t<double> &v, size_t start, size_t stop
 );
 
 /* This function returns the factorial of a positive integer. */
@@ -138,6 +146,13 @@ static libSphysl::engine_t generator(
 	engine.calculator = calculator<relativistic, smoothed>;
 	engine.destructor = libSphysl::utility::destructor<arg_t>;
 
+	/* If the database is changed, we are regenerated the same way. */
+	engine.generator = [smoothing](libSphysl::sandbox_t* s) {
+		return std::list<libSphysl::engine_t>{
+			generator<relativistic, smoothed>(s, smoothing)
+		};
+	};
+
 	/* Get the variables we need from the config. */
 	const auto& entities = std::get<size_t>(
 		s -> config_get("entity count")
@@ -148,24 +163,31 @@ static libSphysl::engine_t generator(
 	const auto& delta_t = get_double(s, "time change");
 	const auto& c = get_double(s, "speed of light");
 
-	/* Get the variables we need from the database. */
-	auto& ms = get_doubles(s, "mass");
-
-	auto& xs = get_doubles(s, "x position");
-	auto& ys = get_doubles(s, "y position");
-	auto& zs = get_doubles(s, "z position");
-
-	auto& v_xs = get_doubles(s, "x velocity");
-	auto& v_ys = get_doubles(s, "y velocity");
-	auto& v_zs = get_doubles(s, "z velocity");
-
-	auto& a_xs = get_doubles(s, "x acceleration");
-	auto& a_ys = get_doubles(s, "y acceleration");
-	auto& a_zs = get_doubles(s, "z acceleration");
-
-	auto& F_xs = get_doubles(s, "x force");
-	auto& F_ys = get_doubles(s, "y force");
-	auto& F_zs = get_doubles(s, "z force");
+	/* Get the variables we need from the database. If every entity has
+	 * the same mass, we slice the single value with a stride of 0, which
+	 * saves us from streaming through a whole column of identical values
+	 * on every tick. */
+	const auto uniform = s -> database_uniform("mass");
+
+	const auto get_masses = [&](size_t start, size_t stop) {
+		if(uniform) {
+			auto& m = std::get<double>(s -> uniform_get("mass"));
+			return libSphysl::utility::slice_t<double>(
+				&m, 0, start, stop
+			);
+		}
+
+		return get_slice(get_doubles(s, "mass"), start, stop);
+	};
+
+	/* The vector quantities may have been packed into vec3_t columns, so
+	 * we slice them through libSphysl::utility::get_axis(), which works
+	 * either way. */
+	const auto get_axis = [&](
+		const std::string& id, size_t start, size_t stop
+	){
+		return libSphysl::utility::get_axis(s, id, start, stop);
+	};
 
 	/* Figure out the division of labour; which threads are going to be
 	 * responsible for which range of the entities in the system. */
@@ -193,26 +215,26 @@ static libSphysl::engine_t generator(
 			/* Generate it on the heap, it will be cleaned up when
 			 * libSphysl::utility::destructor<arg_t>() runs. */
 			return new arg_t{
-				delta_t, c,
+				delta_t, c, stop - start,
 				
 				/* Call our helper functions as appropriate. */
-				get_slice(ms, start, stop),
+				get_masses(start, stop),
 
-				get_slice(xs, start, stop),
-				get_slice(ys, start, stop),
-				get_slice(zs, start, stop),
+				get_axis("x position", start, stop),
+				get_axis("y position", start, stop),
+				get_axis("z position", start, stop),
 
-				get_slice(v_xs, start, stop),
-				get_slice(v_ys, start, stop),
-				get_slice(v_zs, start, stop),
+				get_axis("x velocity", start, stop),
+				get_axis("y velocity", start, stop),
+				get_axis("z velocity", start, stop),
 
-				get_slice(a_xs, start, stop),
-				get_slice(a_ys, start, stop),
-				get_slice(a_zs, start, stop),
+				get_axis("x acceleration", start, stop),
+				get_axis("y acceleration", start, stop),
+				get_axis("z acceleration", start, stop),
 
-				get_slice(F_xs, start, stop),
-				get_slice(F_ys, start, stop),
-				get_slice(F_zs, start, stop),
+				get_axis("x force", start, stop),
+				get_axis("y force", start, stop),
+				get_axis("z force", start, stop),
 				
 				/* The following values aren't used, so we will
 				 * null them out here. */
@@ -245,26 +267,26 @@ static libSphysl::engine_t generator(
 			}
 
 			return new arg_t{
-				delta_t, c,
+				delta_t, c, stop - start,
 				
 				/* Call our helper functions as appropriate. */
-				get_slice(ms, start, stop),
+				get_masses(start, stop),
 
-				get_slice(xs, start, stop),
-				get_slice(ys, start, stop),
-				get_slice(zs, start, stop),
+				get_axis("x position", start, stop),
+				get_axis("y position", start, stop),
+				get_axis("z position", start, stop),
 
-				get_slice(v_xs, start, stop),
-				get_slice(v_ys, start, stop),
-				get_slice(v_zs, start, stop),
+				get_axis("x velocity", start, stop),
+				get_axis("y velocity", start, stop),
+				get_axis("z velocity", start, stop),
 
-				get_slice(a_xs, start, stop),
-				get_slice(a_ys, start, stop),
-				get_slice(a_zs, start, stop),
+				get_axis("x acceleration", start, stop),
+				get_axis("y acceleration", start, stop),
+				get_axis("z acceleration", start, stop),
 
-				get_slice(F_xs, start, stop),
-				get_slice(F_ys, start, stop),
-				get_slice(F_zs, start, stop),
+				get_axis("x force", start, stop),
+				get_axis("y force", start, stop),
+				get_axis("z force", start, stop),
 
 				depth, false, // initialised.
 				pairs, pairs, pairs, // dv_xs, dv_ys, dv_zs.
@@ -290,15 +312,15 @@ static double& get_double(libSphysl::sandbox_t* s, const std::string& id) {
 	return std::get<double>(s -> config_get(id));
 }
 
-static std::vector<double>& get_doubles(
+static libSphysl::column_t<double>& get_doubles(
 	libSphysl::sandbox_t* s, const std::string& id
 ){
 	/* No need to keep typing this sentence again and again! */
-	return std::get<std::vector<double>>(s -> database_get(id));
+	return std::get<libSphysl::column_t<double>>(s -> database_get(id));
 }
 
 static libSphysl::utility::slice_t<double> get_slice(
-	std::vector<double> &v, size_t start, size_t stop
+	libSphysl::column_t<double> &v, size_t start, size_t stop
 ){
 	/* No need to keep typing this sentence again and again! */
 	return libSphysl::utility::slice_t<double>(v, start, stop);
@@ -327,11 +349,9 @@ template<bool relativistic, bool smoothed> static void calculator(void *arg) {
 		(data.initialised? smoothed_helper<relativistic, true>:
 		smoothed_helper<relativistic, false>);
 
-	/* Loop across the slices and compute for each entity. */
-	size_t i = 0; // Index variable that we'll use for our caching vectors.
-	for(const auto& m: data.m) {
-		(void) m; // We don't actually use this index variable.
-
+	/* Loop across the slices and compute for each entity. The index is
+	 * also used for our caching vectors. */
+	for(size_t i = 0; i < data.count; i++) {
 		/* Call the appropriate helper function. */
 		helper(i, data);
 
@@ -345,9 +365,6 @@ template<bool relativistic, bool smoothed> static void calculator(void *arg) {
 		data.a_x++; data.a_y++; data.a_z++;
 		data.v_x++; data.v_y++; data.v_z++;
 		data.x++; data.y++; data.z++;
-
-		/* Update index variable. */
-		i++;
 	}
 
 	/* Reset the slices back to the beginning. */
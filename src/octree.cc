@@ -0,0 +1,1115 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl/charges.h>
+#include <libSphysl/gravity.h>
+#include <libSphysl/utility.h>
+
+/* Structure Declarations */
+
+/* Every source file has its own arg_t, so they're kept in an anonymous
+ * namespace to stop the linker from merging their destructor<arg_t>'s. */
+namespace {
+
+/* The nodes are stored depth-first, so the children of a node come right
+ * after it, and next is the index of the first node after its subtree. This
+ * lets the tree be walked without a stack, and a node is a leaf if next is
+ * the node right after it. */
+struct node_t {
+	double m, x, y, z; // Total mass and centre of mass.
+	double reach_sq; // Square of the distance it's opened within.
+
+	size_t next; // Index of the node after this one's subtree.
+	size_t first, last; // The bodies in its subtree.
+};
+
+/* This is everything the stages of a tick share. The masses are charges
+ * instead when we're working out the electric forces. */
+struct tree_t {
+	const double& constant; // G, or the vacuum permittivity.
+	const double& theta; // The opening angle.
+
+	const size_t total; // Number of entities.
+
+	libSphysl::utility::slice_t<double> m, x, y, z;
+	libSphysl::utility::slice_t<double> F_x, F_y, F_z;
+
+	/* The ranges of entities that each thread handles, and the bounds
+	 * of the entities in each of them. */
+	std::vector<std::pair<size_t, size_t>> ranges;
+	std::vector<std::pair<libSphysl::vec3_t, libSphysl::vec3_t>> bounds;
+
+	/* The key of each entity along the Morton curve, sorted, and the
+	 * bodies copied out in that order. */
+	std::vector<std::pair<uint64_t, size_t>> keys;
+	std::vector<double> b_m, b_x, b_y, b_z;
+
+	std::vector<node_t> nodes;
+
+	/* The middle of the cube of each node, and the furthest that any of
+	 * its bodies is from there. */
+	std::vector<libSphysl::vec3_t> centres;
+	std::vector<double> radii;
+
+	/* The rest is only used by the multipole method. */
+
+	size_t order; // Highest order of the expansions.
+	bool coulomb; // Whether the forces are electric.
+
+	/* The tree is split into subtrees of at most a fixed number of bodies,
+	 * which are worked on by one thread each, and the nodes above them,
+	 * which are worked on by one thread once the subtrees are done. */
+	std::vector<size_t> branches, tops;
+
+	/* The powers of each term of an expansion along the axes, ordered by
+	 * their total; the index of the term for each combination of powers;
+	 * and the number of terms up to each total. */
+	std::vector<std::array<size_t, 3>> powers;
+	std::vector<size_t> terms;
+	std::vector<size_t> counts;
+
+	/* For each term, the axis that the recurrence for the derivatives
+	 * steps down along, the terms one and two steps down and the power
+	 * less one; and for each term of a local expansion in turn, the
+	 * derivative that goes with each term of a multipole expansion that
+	 * it's made up of. */
+	std::vector<std::array<size_t, 4>> steps;
+	std::vector<size_t> shifts;
+
+	/* The multipole and local expansions of each node, one after the
+	 * other, and the field at each body. */
+	std::vector<double> multipoles, locals;
+	std::vector<double> g_x, g_y, g_z;
+};
+
+/* There's one of these for every thread in every stage, and the stages that
+ * can't be split up just have the one. */
+struct arg_t {
+	std::shared_ptr<tree_t> tree;
+	size_t range; // Index of our range in the tree's ranges.
+
+	/* Room for working out the terms of an expansion. */
+	std::vector<double> scratch;
+};
+
+}
+
+/* Constants Declarations */
+
+/* The keys are 63-bit integers, which gives us 21 levels to the tree. */
+static const size_t bits = 21;
+
+/* The most bodies that a leaf holds before it's split. Walking through a few
+ * bodies directly is cheaper than walking through more nodes. */
+static const size_t leaf_size = 16;
+
+/* The multipole method does best with bigger leaves, since the interactions
+ * between nodes cost far more than those between bodies. */
+static const size_t expanded_leaf_size = 64;
+
+/* The number of pieces the multipole method splits the tree into, roughly.
+ * It's fixed rather than depending on the number of threads, since where the
+ * tree is split changes which interactions are worked out. */
+static const size_t pieces = 256;
+
+static const double pi = 3.14159265358979323846;
+
+/* Function Declarations */
+
+/* This is the templated function that generates all the engines. */
+template<bool multipole, bool coulomb>
+static std::list<libSphysl::engine_t> generator(libSphysl::sandbox_t* s);
+
+/* These are the calculators for each stage, in the order that they run. The
+ * Barnes-Hut method walks the tree right after it's built, and the multipole
+ * method goes up it and then back down it instead. */
+static void bounder(void* arg);
+static void keyer(void* arg);
+static void merger(void* arg);
+static void gatherer(void* arg);
+static void builder(void* arg);
+static void walker(void* arg);
+
+static void upward(void* arg);
+static void summit(void* arg);
+static void downward(void* arg);
+
+/* This works out the corner and side of the cube around all the entities. */
+static void cube(const tree_t& tree, libSphysl::vec3_t& corner, double& side);
+
+/* This builds the node for the bodies from first to last, which are in a
+ * cube of the given side at the given corner and level, and then recurses
+ * into its children. */
+static void build(
+	tree_t& tree, size_t first, size_t last, size_t level,
+	const libSphysl::vec3_t& corner, double side
+);
+
+/* This spreads the bits of a 21-bit integer out so that there are two zero
+ * bits in between each of them. */
+static uint64_t spread(uint64_t v);
+
+/* This works out the multipole expansion of a node from its bodies or from
+ * its children's expansions. */
+static void expand(arg_t& data, size_t n);
+
+/* These work out the interactions of the bodies in a node with everything
+ * in another one, and hand the local expansion of a node down to its bodies,
+ * through its children. */
+static void interact(arg_t& data, size_t a, size_t b);
+static void descend(arg_t& data, size_t n);
+
+/* These fill the scratch space with the terms of an expansion at the given
+ * point; d^a / a! for each of the powers a up to the given order, and the
+ * derivatives of 1 / |d| with respect to each of them. */
+static void monomials(arg_t& data, const libSphysl::vec3_t& d, size_t order);
+static void derivatives(arg_t& data, const libSphysl::vec3_t& d);
+
+/* This gets the index of the term with the given powers. */
+static size_t term(const tree_t& tree, size_t x, size_t y, size_t z);
+
+/* Function Definitions */
+
+std::list<libSphysl::engine_t> libSphysl::gravity::barnes_hut(
+	libSphysl::sandbox_t* s
+){
+	/* Call the templated generator with the appropriate parameters. */
+	return generator<false, false>(s);
+}
+
+std::list<libSphysl::engine_t> libSphysl::gravity::multipole(
+	libSphysl::sandbox_t* s
+){
+	/* Call the templated generator with the appropriate parameters. */
+	return generator<true, false>(s);
+}
+
+std::list<libSphysl::engine_t> libSphysl::charges::multipole(
+	libSphysl::sandbox_t* s
+){
+	/* Call the templated generator with the appropriate parameters. */
+	return generator<true, true>(s);
+}
+
+template<bool multipole, bool coulomb>
+static std::list<libSphysl::engine_t> generator(libSphysl::sandbox_t* s) {
+	/* Get the variables we need from the config. */
+	const auto total = std::get<size_t>(s -> config_get("entity count"));
+	const auto threads = s -> threads.size(); // Not stored in config.
+
+	const auto& constant = std::get<double>(s -> config_get(
+		coulomb? "vacuum permittivity": "gravitational constant"
+	));
+
+	const auto& theta = std::get<double>(
+		s -> config_get("opening angle")
+	);
+
+	const auto order = multipole? std::get<size_t>(
+		s -> config_get("expansion order")
+	): 0;
+
+	if(multipole && !order) throw std::invalid_argument(
+		"the expansion order must be at least 1"
+	);
+
+	/* Past 1, a cell could be far enough away from a body or another cell
+	 * inside it, and 0 would have the walks divide by zero. */
+	if(!(theta > 0.0 && theta <= 1.0)) throw std::invalid_argument(
+		"the opening angle must be more than 0 and at most 1"
+	);
+
+	/* Get the variables we need from the database, slicing a uniform
+	 * mass or charge with a stride of 0. */
+	const auto id = coulomb? "charge": "mass";
+
+	const auto masses = [&]() {
+		if(s -> database_uniform(id)) {
+			auto& m = std::get<double>(s -> uniform_get(id));
+			return libSphysl::utility::slice_t<double>(
+				&m, 0, 0, total
+			);
+		}
+
+		return libSphysl::utility::slice_t<double>(
+			std::get<libSphysl::column_t<double>>(
+				s -> database_get(id)
+			), 0, total
+		);
+	}();
+
+	const auto get_axis = [&](const std::string& id) {
+		return libSphysl::utility::get_axis(s, id, 0, total);
+	};
+
+	auto tree = std::make_shared<tree_t>(tree_t{
+		constant, theta, total, masses,
+
+		get_axis("x position"),
+		get_axis("y position"),
+		get_axis("z position"),
+
+		get_axis("x force"),
+		get_axis("y force"),
+		get_axis("z force"),
+
+		{}, {}, {}, {}, {}, {}, {}, {}, {}, {},
+		order, coulomb,
+		{}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}
+	});
+
+	/* Give each thread its own range of entities. */
+	for(const auto& range: libSphysl::utility::divide_range(
+		0, total, threads
+	)) if(range.first != range.second) tree -> ranges.push_back(range);
+
+	tree -> bounds.resize(tree -> ranges.size());
+	tree -> keys.resize(total);
+
+	tree -> b_m.resize(total); tree -> b_x.resize(total);
+	tree -> b_y.resize(total); tree -> b_z.resize(total);
+
+	/* List the terms of the expansions by their total power, which is
+	 * the order in which the derivatives are worked out. */
+	if constexpr(multipole) {
+		const auto width = order + 1;
+		tree -> terms.resize(width * width * width);
+
+		for(size_t sum = 0; sum < width; sum++) {
+			for(size_t x = sum + 1; x--;) {
+				for(size_t y = sum - x + 1; y--;) {
+					const auto z = sum - x - y;
+
+					tree -> terms[
+						(x * width + y) * width + z
+					] = tree -> powers.size();
+
+					tree -> powers.push_back({x, y, z});
+				}
+			}
+
+			tree -> counts.push_back(tree -> powers.size());
+		}
+
+		const auto index = [&](size_t x, size_t y, size_t z) {
+			return tree -> terms[(x * width + y) * width + z];
+		};
+
+		for(const auto& [x, y, z]: tree -> powers) {
+			auto p = std::array<size_t, 3>{x, y, z};
+			const size_t axis = x? 0: y? 1: 2;
+
+			if(!p[axis]) {
+				tree -> steps.push_back({});
+				continue;
+			}
+
+			const auto power = p[axis]--;
+			const auto one = index(p[0], p[1], p[2]);
+
+			if(p[axis]) p[axis]--;
+			const auto two = index(p[0], p[1], p[2]);
+
+			tree -> steps.push_back({axis, one, two, power - 1});
+		}
+
+		for(size_t i = 0; i < tree -> powers.size(); i++) {
+			const auto [x, y, z] = tree -> powers[i];
+			const auto rest = tree -> counts[order - x - y - z];
+
+			for(size_t j = 0; j < rest; j++) {
+				const auto [u, v, w] = tree -> powers[j];
+				tree -> shifts.push_back(
+					index(x + u, y + v, z + w)
+				);
+			}
+		}
+
+		tree -> g_x.resize(total); tree -> g_y.resize(total);
+		tree -> g_z.resize(total);
+	}
+
+	/* Set up the engines for the stages. The ones that run in parallel
+	 * get an arg for every range, and the rest get just the one. */
+	std::list<libSphysl::engine_t> engines;
+
+	const auto calculators = multipole? std::vector<void (*)(void*)>{
+		bounder, keyer, merger, gatherer, builder,
+		upward, summit, downward
+	}: std::vector<void (*)(void*)>{
+		bounder, keyer, merger, gatherer, builder, walker
+	};
+
+	for(const auto calculator: calculators) {
+		libSphysl::engine_t engine;
+
+		engine.calculator = calculator;
+		engine.destructor = libSphysl::utility::destructor<arg_t>;
+
+		const auto parallel = calculator != merger
+			&& calculator != builder && calculator != summit;
+
+		const auto args = parallel? tree -> ranges.size(): 1;
+
+		/* The derivatives need room for each of the terms, for every
+		 * step of the recurrence. */
+		const auto room = tree -> powers.size() * (order + 1);
+
+		for(size_t i = 0; i < args; i++) {
+			auto arg = new arg_t{
+				tree, i, std::vector<double>(room)
+			};
+
+			engine.args.push_back(reinterpret_cast<void*>(arg));
+		}
+
+		engines.push_back(engine);
+	}
+
+	/* If the database is changed, we are regenerated the same way. */
+	engines.front().generator = [](libSphysl::sandbox_t* s) {
+		return generator<multipole, coulomb>(s);
+	};
+
+	engines.front().span = engines.size();
+	return engines;
+}
+
+static void bounder(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& tree = *data.tree;
+
+	/* Find the bounds of the entities in our range. */
+	const auto [start, stop] = tree.ranges[data.range];
+
+	libSphysl::vec3_t min{tree.x[start], tree.y[start], tree.z[start]};
+	auto max = min;
+
+	for(size_t i = start + 1; i < stop; i++) {
+		min.x = std::min(min.x, tree.x[i]);
+		min.y = std::min(min.y, tree.y[i]);
+		min.z = std::min(min.z, tree.z[i]);
+
+		max.x = std::max(max.x, tree.x[i]);
+		max.y = std::max(max.y, tree.y[i]);
+		max.z = std::max(max.z, tree.z[i]);
+	}
+
+	tree.bounds[data.range] = {min, max};
+}
+
+static void keyer(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& tree = *data.tree;
+
+	/* Every thread works out the cube for itself, since it's cheap. */
+	libSphysl::vec3_t corner;
+	double side;
+
+	cube(tree, corner, side);
+
+	/* Map the cube onto the integer grid the keys are computed on. */
+	const auto scale = static_cast<double>(1 << bits) / side;
+	const auto grid = [&](double v, double low) {
+		const auto g = static_cast<uint64_t>((v - low) * scale);
+		return std::min(g, static_cast<uint64_t>((1 << bits) - 1));
+	};
+
+	/* Compute the key of every entity in our range and sort them, so
+	 * that the merger only has to merge the sorted runs. */
+	const auto [start, stop] = tree.ranges[data.range];
+
+	for(size_t i = start; i < stop; i++) {
+		tree.keys[i] = {
+			spread(grid(tree.x[i], corner.x))
+			| (spread(grid(tree.y[i], corner.y)) << 1)
+			| (spread(grid(tree.z[i], corner.z)) << 2), i
+		};
+	}
+
+	std::sort(tree.keys.begin() + start, tree.keys.begin() + stop);
+}
+
+static void merger(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& tree = *reinterpret_cast<arg_t*>(arg) -> tree;
+
+	/* Merge neighbouring runs pairwise until there's only one left. */
+	const auto& ranges = tree.ranges;
+	const auto keys = tree.keys.begin();
+
+	for(size_t width = 1; width < ranges.size(); width *= 2) {
+		for(size_t i = 0; i + width < ranges.size(); i += width * 2) {
+			const auto last = std::min(
+				i + width * 2, ranges.size()
+			) - 1;
+
+			std::inplace_merge(
+				keys + ranges[i].first,
+				keys + ranges[i + width].first,
+				keys + ranges[last].second
+			);
+		}
+	}
+}
+
+static void gatherer(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& tree = *data.tree;
+
+	/* Copy the bodies out in the order of the keys, so that the ones in
+	 * each leaf are next to each other. */
+	const auto [start, stop] = tree.ranges[data.range];
+
+	for(size_t i = start; i < stop; i++) {
+		const auto j = tree.keys[i].second;
+
+		tree.b_m[i] = tree.m[j];
+		tree.b_x[i] = tree.x[j];
+		tree.b_y[i] = tree.y[j];
+		tree.b_z[i] = tree.z[j];
+	}
+}
+
+static void builder(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& tree = *reinterpret_cast<arg_t*>(arg) -> tree;
+
+	tree.nodes.clear();
+	tree.centres.clear();
+	tree.radii.clear();
+
+	tree.branches.clear();
+	tree.tops.clear();
+
+	if(!tree.total) return;
+
+	libSphysl::vec3_t corner;
+	double side;
+
+	cube(tree, corner, side);
+	build(tree, 0, tree.total, 0, corner, side);
+
+	if(!tree.order) return;
+
+	/* Split the tree for the multipole method, going down it until the
+	 * nodes are small enough. */
+	const auto limit = (tree.total + pieces - 1) / pieces;
+
+	for(size_t n = 0; n < tree.nodes.size();) {
+		const auto& node = tree.nodes[n];
+
+		if(node.last - node.first <= limit || node.next == n + 1) {
+			tree.branches.push_back(n);
+			n = node.next;
+		}
+
+		else {
+			tree.tops.push_back(n);
+			n++;
+		}
+	}
+
+	const auto size = tree.nodes.size() * tree.counts[tree.order];
+	tree.multipoles.resize(size);
+	tree.locals.resize(size);
+}
+
+static void walker(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& tree = *data.tree;
+
+	const auto nodes = tree.nodes.data();
+	const auto count = tree.nodes.size();
+
+	/* Our range is in the order of the keys, so the bodies one after the
+	 * other walk mostly the same nodes. */
+	const auto [start, stop] = tree.ranges[data.range];
+
+	for(size_t i = start; i < stop; i++) {
+		const auto x = tree.b_x[i], y = tree.b_y[i], z = tree.b_z[i];
+		double a_x = 0.0, a_y = 0.0, a_z = 0.0;
+
+		for(size_t n = 0; n < count;) {
+			const auto& node = nodes[n];
+
+			const auto d_x = node.x - x;
+			const auto d_y = node.y - y;
+			const auto d_z = node.z - z;
+
+			const auto r_sq = d_x * d_x + d_y * d_y + d_z * d_z;
+
+			/* Far enough away; treat it as a single body. */
+			if(r_sq > node.reach_sq) {
+				const auto r_inv = 1.0 / std::sqrt(r_sq);
+				const auto k = node.m * r_inv * r_inv * r_inv;
+
+				a_x += k * d_x; a_y += k * d_y; a_z += k * d_z;
+				n = node.next; continue;
+			}
+
+			/* Too close, so go into its children. */
+			if(node.next != n + 1) {
+				n++; continue;
+			}
+
+			/* A leaf that's too close is summed directly, skipping
+			 * the body itself. */
+			for(size_t j = node.first; j < node.last; j++) {
+				const auto e_x = tree.b_x[j] - x;
+				const auto e_y = tree.b_y[j] - y;
+				const auto e_z = tree.b_z[j] - z;
+
+				const auto s_sq = e_x * e_x + e_y * e_y
+					+ e_z * e_z;
+
+				if(!(s_sq > 0.0)) continue;
+
+				const auto s_inv = 1.0 / std::sqrt(s_sq);
+				const auto k = tree.b_m[j]
+					* s_inv * s_inv * s_inv;
+
+				a_x += k * e_x; a_y += k * e_y; a_z += k * e_z;
+			}
+
+			n = node.next;
+		}
+
+		/* F = G * m_i * sum(m_j * r / |r|^3) */
+		const auto j = tree.keys[i].second;
+		const auto k = tree.constant * tree.b_m[i];
+
+		tree.F_x[j] += k * a_x;
+		tree.F_y[j] += k * a_y;
+		tree.F_z[j] += k * a_z;
+	}
+}
+
+static void upward(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& tree = *data.tree;
+
+	/* We take the subtrees that start in our range of bodies, and work
+	 * out their expansions from the bottom up. The children of a node
+	 * always come after it, so going backwards does just that. */
+	const auto [start, stop] = tree.ranges[data.range];
+
+	for(const auto b: tree.branches) {
+		const auto first = tree.nodes[b].first;
+		if(first < start || first >= stop) continue;
+
+		for(auto n = tree.nodes[b].next; n-- > b;) expand(data, n);
+	}
+}
+
+static void summit(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& tree = *data.tree;
+
+	/* Finish off the nodes above the subtrees, from the bottom up. */
+	for(auto n = tree.tops.rbegin(); n != tree.tops.rend(); n++) {
+		expand(data, *n);
+	}
+}
+
+static void downward(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& tree = *data.tree;
+
+	const auto terms = tree.counts[tree.order];
+	const auto [start, stop] = tree.ranges[data.range];
+
+	/* Gravity pulls the bodies towards each other, while like charges
+	 * push each other away. */
+	const auto factor = tree.coulomb?
+		-1.0 / (4.0 * pi * tree.constant): tree.constant;
+
+	for(const auto b: tree.branches) {
+		const auto& branch = tree.nodes[b];
+		if(branch.first < start || branch.first >= stop) continue;
+
+		/* Clear the local expansions of the subtree and the fields at
+		 * its bodies. */
+		std::fill(
+			tree.locals.begin() + b * terms,
+			tree.locals.begin() + branch.next * terms, 0.0
+		);
+
+		for(size_t i = branch.first; i < branch.last; i++) {
+			tree.g_x[i] = tree.g_y[i] = tree.g_z[i] = 0.0;
+		}
+
+		/* Work out everything acting on the subtree, starting from
+		 * the root, and hand it down to the bodies. Since we only ever
+		 * write to our own subtree, no other thread gets in the way. */
+		interact(data, b, 0);
+		descend(data, b);
+
+		for(size_t i = branch.first; i < branch.last; i++) {
+			const auto j = tree.keys[i].second;
+			const auto k = factor * tree.b_m[i];
+
+			tree.F_x[j] += k * tree.g_x[i];
+			tree.F_y[j] += k * tree.g_y[i];
+			tree.F_z[j] += k * tree.g_z[i];
+		}
+	}
+}
+
+static void cube(const tree_t& tree, libSphysl::vec3_t& corner, double& side) {
+	/* Combine the bounds of each range. */
+	auto [min, max] = tree.bounds[0];
+
+	for(const auto& [low, high]: tree.bounds) {
+		min.x = std::min(min.x, low.x); max.x = std::max(max.x, high.x);
+		min.y = std::min(min.y, low.y); max.y = std::max(max.y, high.y);
+		min.z = std::min(min.z, low.z); max.z = std::max(max.z, high.z);
+	}
+
+	/* The cells of an octree are cubes, so the root has to be one too.
+	 * It's given a little room on every side so that nothing sits on its
+	 * edges, and a size of 1 if every entity is in the same place. */
+	side = std::max({max.x - min.x, max.y - min.y, max.z - min.z});
+	side = side > 0.0? side * 1.001: 1.0;
+
+	corner = {
+		(min.x + max.x - side) / 2,
+		(min.y + max.y - side) / 2,
+		(min.z + max.z - side) / 2
+	};
+}
+
+static void build(
+	tree_t& tree, size_t first, size_t last, size_t level,
+	const libSphysl::vec3_t& corner, double side
+){
+	/* The node can't be kept as a reference, since building its children
+	 * may move the nodes around in memory. */
+	const auto n = tree.nodes.size();
+	tree.nodes.push_back({0.0, 0.0, 0.0, 0.0, 0.0, 0, first, last});
+
+	const auto half = side / 2;
+
+	tree.centres.push_back({
+		corner.x + half, corner.y + half, corner.z + half
+	});
+
+	tree.radii.push_back(0.0);
+
+	double m = 0.0, x = 0.0, y = 0.0, z = 0.0, r_sq = 0.0;
+
+	/* Small enough to be a leaf; add up its bodies. The order is only
+	 * ever 0 for the Barnes-Hut method. */
+	const auto size = tree.order? expanded_leaf_size: leaf_size;
+
+	if(last - first <= size || level == bits) {
+		for(size_t i = first; i < last; i++) {
+			m += tree.b_m[i];
+			x += tree.b_m[i] * tree.b_x[i];
+			y += tree.b_m[i] * tree.b_y[i];
+			z += tree.b_m[i] * tree.b_z[i];
+
+			const auto d_x = tree.b_x[i] - tree.centres[n].x;
+			const auto d_y = tree.b_y[i] - tree.centres[n].y;
+			const auto d_z = tree.b_z[i] - tree.centres[n].z;
+
+			r_sq = std::max(
+				r_sq, d_x * d_x + d_y * d_y + d_z * d_z
+			);
+		}
+
+		tree.radii[n] = std::sqrt(r_sq);
+	}
+
+	/* Otherwise split the bodies between the eight octants, which are
+	 * given by the next three bits of the keys and come one after the
+	 * other since the keys are sorted, and add up the children instead. */
+	else for(uint64_t octant = 0, stop = first; octant < 8; octant++) {
+		const auto shift = 3 * (bits - 1 - level);
+
+		const auto begin = stop;
+		stop = std::partition_point(
+			tree.keys.begin() + begin, tree.keys.begin() + last,
+			[&](const std::pair<uint64_t, size_t>& key) {
+				return ((key.first >> shift) & 7) <= octant;
+			}
+		) - tree.keys.begin();
+
+		if(stop == begin) continue;
+
+		const auto c = tree.nodes.size();
+
+		build(tree, begin, stop, level + 1, {
+			corner.x + ((octant & 1)? half: 0.0),
+			corner.y + ((octant & 2)? half: 0.0),
+			corner.z + ((octant & 4)? half: 0.0)
+		}, half);
+
+		const auto& child = tree.nodes[c];
+
+		m += child.m;
+		x += child.m * child.x;
+		y += child.m * child.y;
+		z += child.m * child.z;
+
+		/* The child's bodies are no further than its own radius
+		 * from its middle, which is a quarter of the way to our
+		 * corners, and never further than our corners themselves. */
+		tree.radii[n] = std::min(std::max(
+			tree.radii[n], tree.radii[c] + half * std::sqrt(3.0) / 2
+		), half * std::sqrt(3.0));
+	}
+
+	/* The node is opened when a body is closer to its centre of mass than
+	 * its side over the opening angle, plus however far the centre of mass
+	 * is from the middle of the cube, so that a body sitting right next to
+	 * a lopsided cube doesn't treat it as far away. */
+	auto& node = tree.nodes[n];
+	const auto& centre = tree.centres[n];
+
+	node.m = m;
+	node.x = m > 0.0? x / m: centre.x;
+	node.y = m > 0.0? y / m: centre.y;
+	node.z = m > 0.0? z / m: centre.z;
+
+	const auto o_x = node.x - centre.x;
+	const auto o_y = node.y - centre.y;
+	const auto o_z = node.z - centre.z;
+
+	const auto reach = side / tree.theta
+		+ std::sqrt(o_x * o_x + o_y * o_y + o_z * o_z);
+
+	node.reach_sq = reach * reach;
+	node.next = tree.nodes.size();
+}
+
+static uint64_t spread(uint64_t v) {
+	/* Each step moves half of the remaining groups of bits upwards, see
+	 * footnote [1] for the derivation of the masks. */
+	v &= 0x1fffff;
+	v = (v | (v << 32)) & 0x1f00000000ffff;
+	v = (v | (v << 16)) & 0x1f0000ff0000ff;
+	v = (v | (v << 8))  & 0x100f00f00f00f00f;
+	v = (v | (v << 4))  & 0x10c30c30c30c30c3;
+	v = (v | (v << 2))  & 0x1249249249249249;
+
+	return v;
+}
+
+static void expand(arg_t& data, size_t n) {
+	auto& tree = *data.tree;
+
+	const auto& node = tree.nodes[n];
+	const auto& centre = tree.centres[n];
+
+	const auto terms = tree.counts[tree.order];
+	const auto M = tree.multipoles.data() + n * terms;
+
+	std::fill(M, M + terms, 0.0);
+
+	/* A leaf's expansion is the sum of m * d^a / a! over its bodies, where
+	 * d is how far each of them is from the middle of the node. */
+	if(node.next == n + 1) {
+		for(size_t i = node.first; i < node.last; i++) {
+			monomials(data, {
+				tree.b_x[i] - centre.x,
+				tree.b_y[i] - centre.y,
+				tree.b_z[i] - centre.z
+			}, tree.order);
+
+			for(size_t a = 0; a < terms; a++) {
+				M[a] += tree.b_m[i] * data.scratch[a];
+			}
+		}
+
+		return;
+	}
+
+	/* Otherwise, each child's expansion is shifted over to the middle of
+	 * this node, with each of its terms with powers b adding M_b * d^(a -
+	 * b) / (a - b)! to every one of ours with powers a that are at least as
+	 * high along every axis. */
+	for(auto c = n + 1; c < node.next; c = tree.nodes[c].next) {
+		const auto& other = tree.centres[c];
+		const auto N = tree.multipoles.data() + c * terms;
+
+		monomials(data, {
+			other.x - centre.x, other.y - centre.y,
+			other.z - centre.z
+		}, tree.order);
+
+		for(size_t a = 0; a < terms; a++) {
+			const auto [x, y, z] = tree.powers[a];
+
+			for(size_t b = 0; b < tree.counts[x + y + z]; b++) {
+				const auto [i, j, k] = tree.powers[b];
+				if(i > x || j > y || k > z) continue;
+
+				M[a] += N[b] * data.scratch[
+					term(tree, x - i, y - j, z - k)
+				];
+			}
+		}
+	}
+}
+
+static void interact(arg_t& data, size_t a, size_t b) {
+	auto& tree = *data.tree;
+
+	const auto& A = tree.nodes[a];
+	const auto& B = tree.nodes[b];
+
+	const auto d = libSphysl::vec3_t{
+		tree.centres[a].x - tree.centres[b].x,
+		tree.centres[a].y - tree.centres[b].y,
+		tree.centres[a].z - tree.centres[b].z
+	};
+
+	const auto r_sq = d.x * d.x + d.y * d.y + d.z * d.z;
+	const auto reach = tree.radii[a] + tree.radii[b];
+
+	/* Far enough apart; B's multipole expansion is turned into a local one
+	 * around A. With the derivatives D of 1 / |d|, each of A's terms with
+	 * powers b gets (-1)^|a| * M_a * D_(a + b) from each of B's terms with
+	 * powers a, as long as the powers add up to no more than the order. */
+	if(reach * reach < tree.theta * tree.theta * r_sq) {
+		derivatives(data, d);
+
+		const auto terms = tree.counts[tree.order];
+		const auto L = tree.locals.data() + a * terms;
+		const auto M = tree.multipoles.data() + b * terms;
+
+		/* The derivatives only take up the start of the scratch once
+		 * they're done, so the signed terms go right after them. */
+		const auto D = data.scratch.data();
+		const auto S = D + terms;
+
+		for(size_t sum = 0, j = 0; sum <= tree.order; sum++) {
+			for(; j < tree.counts[sum]; j++) {
+				S[j] = sum % 2? -M[j]: M[j];
+			}
+		}
+
+		auto k = tree.shifts.data();
+
+		for(size_t i = 0; i < terms; i++) {
+			const auto [x, y, z] = tree.powers[i];
+			const auto rest = tree.counts[tree.order - x - y - z];
+
+			double sum = 0.0;
+			for(size_t j = 0; j < rest; j++) sum += S[j] * D[k[j]];
+
+			L[i] += sum;
+			k += rest;
+		}
+
+		return;
+	}
+
+	const auto leaf_a = A.next == a + 1, leaf_b = B.next == b + 1;
+
+	/* Two leaves that are too close are summed directly, skipping the
+	 * bodies themselves. */
+	if(leaf_a && leaf_b) {
+		for(size_t i = A.first; i < A.last; i++) {
+			const auto x = tree.b_x[i], y = tree.b_y[i];
+			const auto z = tree.b_z[i];
+
+			double g_x = 0.0, g_y = 0.0, g_z = 0.0;
+
+			for(size_t j = B.first; j < B.last; j++) {
+				const auto e_x = tree.b_x[j] - x;
+				const auto e_y = tree.b_y[j] - y;
+				const auto e_z = tree.b_z[j] - z;
+
+				const auto s_sq = e_x * e_x + e_y * e_y
+					+ e_z * e_z;
+
+				if(!(s_sq > 0.0)) continue;
+
+				const auto s_inv = 1.0 / std::sqrt(s_sq);
+				const auto k = tree.b_m[j]
+					* s_inv * s_inv * s_inv;
+
+				g_x += k * e_x; g_y += k * e_y; g_z += k * e_z;
+			}
+
+			tree.g_x[i] += g_x; tree.g_y[i] += g_y;
+			tree.g_z[i] += g_z;
+		}
+
+		return;
+	}
+
+	/* Otherwise, split the bigger of the two. */
+	if(leaf_b || (!leaf_a && tree.radii[a] >= tree.radii[b])) {
+		for(auto c = a + 1; c < A.next; c = tree.nodes[c].next) {
+			interact(data, c, b);
+		}
+	}
+
+	else for(auto c = b + 1; c < B.next; c = tree.nodes[c].next) {
+		interact(data, a, c);
+	}
+}
+
+static void descend(arg_t& data, size_t n) {
+	auto& tree = *data.tree;
+
+	const auto& node = tree.nodes[n];
+	const auto& centre = tree.centres[n];
+
+	const auto terms = tree.counts[tree.order];
+	const auto L = tree.locals.data() + n * terms;
+
+	/* At a leaf, the field at each body is the gradient of the local
+	 * expansion there; the sum of L_(b + e) * d^b / b! for each axis e. */
+	if(node.next == n + 1) {
+		const auto rest = tree.counts[tree.order - 1];
+
+		for(size_t i = node.first; i < node.last; i++) {
+			monomials(data, {
+				tree.b_x[i] - centre.x,
+				tree.b_y[i] - centre.y,
+				tree.b_z[i] - centre.z
+			}, tree.order - 1);
+
+			for(size_t b = 0; b < rest; b++) {
+				const auto [x, y, z] = tree.powers[b];
+				const auto d = data.scratch[b];
+
+				tree.g_x[i] += L[term(tree, x + 1, y, z)] * d;
+				tree.g_y[i] += L[term(tree, x, y + 1, z)] * d;
+				tree.g_z[i] += L[term(tree, x, y, z + 1)] * d;
+			}
+		}
+
+		return;
+	}
+
+	/* Otherwise, the expansion is shifted over to the middle of each
+	 * child, with each of our terms with powers a adding L_a * d^(a - b) /
+	 * (a - b)! to every one of the child's with powers b that are no
+	 * higher along any axis, and then handed down from there. */
+	for(auto c = n + 1; c < node.next; c = tree.nodes[c].next) {
+		const auto& other = tree.centres[c];
+		const auto K = tree.locals.data() + c * terms;
+
+		monomials(data, {
+			other.x - centre.x, other.y - centre.y,
+			other.z - centre.z
+		}, tree.order);
+
+		for(size_t b = 0; b < terms; b++) {
+			const auto [x, y, z] = tree.powers[b];
+			const auto rest = tree.counts[tree.order - x - y - z];
+
+			for(size_t e = 0; e < rest; e++) {
+				const auto [i, j, k] = tree.powers[e];
+
+				K[b] += L[term(tree, x + i, y + j, z + k)]
+					* data.scratch[e];
+			}
+		}
+
+		descend(data, c);
+	}
+}
+
+static void monomials(arg_t& data, const libSphysl::vec3_t& d, size_t order) {
+	const auto& tree = *data.tree;
+	auto& out = data.scratch;
+
+	/* Each term is the one with one less of its first power, times that
+	 * axis of d over the power. */
+	out[0] = 1.0;
+
+	for(size_t a = 1; a < tree.counts[order]; a++) {
+		const auto [x, y, z] = tree.powers[a];
+
+		if(x) out[a] = out[term(tree, x - 1, y, z)] * d.x / x;
+		else if(y) out[a] = out[term(tree, x, y - 1, z)] * d.y / y;
+		else out[a] = out[term(tree, x, y, z - 1)] * d.z / z;
+	}
+}
+
+static void derivatives(arg_t& data, const libSphysl::vec3_t& d) {
+	const auto& tree = *data.tree;
+	auto& R = data.scratch;
+
+	const auto top = tree.order;
+	const auto size = tree.powers.size();
+	const std::array<double, 3> e{d.x, d.y, d.z};
+
+	/* This is the recurrence of McMurchie and Davidson for a point (see
+	 * footnote [2]), where R^n_a is kept at R[n * size + a], with R^n_0 =
+	 * (-1)^n (2n - 1)!! / |d|^(2n + 1) and the derivatives we want being
+	 * R^0_a. Each R^n_a is worked out from R^(n + 1) for the terms with a
+	 * total power that's one or two lower, so R^n is only needed up to
+	 * the order less n, and R^0 ends up at the start of the scratch. */
+	const auto r_sq_inv = 1.0 / (d.x * d.x + d.y * d.y + d.z * d.z);
+	R[0] = std::sqrt(r_sq_inv);
+
+	for(size_t n = 1; n <= top; n++) {
+		R[n * size] = -(2.0 * n - 1.0) * R[(n - 1) * size] * r_sq_inv;
+	}
+
+	for(size_t sum = 1; sum <= top; sum++) {
+		for(size_t n = 0; n + sum <= top; n++) {
+			const auto prev = R.data() + (n + 1) * size;
+			const auto next = R.data() + n * size;
+
+			const auto first = tree.counts[sum - 1];
+			const auto last = tree.counts[sum];
+
+			/* Step down along the first axis we can. */
+			for(auto a = first; a < last; a++) {
+				const auto& [axis, one, two, power]
+					= tree.steps[a];
+
+				next[a] = e[axis] * prev[one] + prev[two]
+					* static_cast<double>(power);
+			}
+		}
+	}
+}
+
+static size_t term(const tree_t& tree, size_t x, size_t y, size_t z) {
+	/* No need to keep typing this sentence again and again! */
+	const auto width = tree.order + 1;
+	return tree.terms[(x * width + y) * width + z];
+}
+
+/* [1] <https://graphics.stanford.edu/~seander/bithacks.html>
+ * [2] L. E. McMurchie and E. R. Davidson, "One- and two-electron integrals
+ *     over cartesian gaussian functions", Journal of Computational Physics
+ *     26, 218 (1978). */
@@ -0,0 +1,232 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <algorithm>
+#include <stdexcept>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl/ordering.h>
+#include <libSphysl/utility.h>
+
+/* Structure Declarations */
+
+/* Every source file has its own arg_t, so they're kept in an anonymous
+ * namespace to stop the linker from merging their destructor<arg_t>'s. */
+namespace {
+
+/* This is the argument that's going to be passed to the calculator. */
+struct arg_t {
+	libSphysl::sandbox_t* s; // The sandbox we're going to reorder.
+
+	const size_t& tick; // Current simulation tick.
+	const size_t& interval; // Number of ticks between reorderings.
+};
+
+}
+
+/* Constants Declarations */
+
+/* The keys are 63-bit integers, which gives us 21 bits along each axis. */
+static const size_t bits = 21;
+
+/* Function Declarations */
+
+/* This is the templated function that generates both of the engines. */
+template<bool hilbert>
+static libSphysl::engine_t generator(libSphysl::sandbox_t* s);
+
+/* This is the calculator that we will be using for the engines, and the task
+ * it schedules to do the actual reordering. */
+template<bool hilbert> static void calculator(void* arg);
+template<bool hilbert> static void reorder(libSphysl::sandbox_t* s);
+
+/* These compute the position of a point along the curves given its position
+ * in space as integers of 21 bits along each axis. */
+static uint64_t morton_key(uint32_t x, uint32_t y, uint32_t z);
+static uint64_t hilbert_key(uint32_t x, uint32_t y, uint32_t z);
+
+/* This spreads the bits of a 21-bit integer out so that there are two zero
+ * bits in between each of them. */
+static uint64_t spread(uint64_t v);
+
+/* Function Definitions */
+
+libSphysl::engine_t libSphysl::ordering::morton(libSphysl::sandbox_t* s) {
+	/* Call the templated generator with the appropriate parameters. */
+	return generator<false>(s);
+}
+
+libSphysl::engine_t libSphysl::ordering::hilbert(libSphysl::sandbox_t* s) {
+	/* Call the templated generator with the appropriate parameters. */
+	return generator<true>(s);
+}
+
+template<bool hilbert>
+static libSphysl::engine_t generator(libSphysl::sandbox_t* s) {
+	/* The engine we're generating. */
+	libSphysl::engine_t engine;
+
+	engine.calculator = calculator<hilbert>;
+	engine.destructor = libSphysl::utility::destructor<arg_t>;
+
+	/* Get the variables we need from the config. */
+	const auto& tick = std::get<size_t>(
+		s -> config_get("simulation tick")
+	);
+
+	const auto& interval = std::get<size_t>(
+		s -> config_get("reordering interval")
+	);
+
+	if(!interval) throw std::invalid_argument(
+		"the reordering interval must be at least 1"
+	);
+
+	/* Only one calculation in this engine; return the generated engine.
+	 * We don't cache anything about the entities, so we don't need to be
+	 * regenerated when they're reordered. */
+	auto arg = new arg_t{s, tick, interval};
+	engine.args.push_back(reinterpret_cast<void*>(arg));
+	return engine;
+}
+
+template<bool hilbert> static void calculator(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+
+	/* The reordering touches every column in the database, so it can't
+	 * be done while the other worksets are running. If the interval has
+	 * since been set to 0, it isn't done at all. */
+	if(!data.interval || data.tick % data.interval) return;
+	data.s -> schedule(reorder<hilbert>);
+}
+
+template<bool hilbert> static void reorder(libSphysl::sandbox_t* s) {
+	/* Get the positions of all the entities. */
+	const auto total = std::get<size_t>(s -> config_get("entity count"));
+	if(!total) return;
+
+	using libSphysl::utility::get_axis;
+
+	const auto xs = get_axis(s, "x position", 0, total);
+	const auto ys = get_axis(s, "y position", 0, total);
+	const auto zs = get_axis(s, "z position", 0, total);
+
+	/* Find the bounding box of the system so that we can map it onto the
+	 * integer grid the keys are computed on. */
+	libSphysl::vec3_t min{xs[0], ys[0], zs[0]}, max = min;
+
+	for(size_t i = 1; i < total; i++) {
+		min.x = std::min(min.x, xs[i]); max.x = std::max(max.x, xs[i]);
+		min.y = std::min(min.y, ys[i]); max.y = std::max(max.y, ys[i]);
+		min.z = std::min(min.z, zs[i]); max.z = std::max(max.z, zs[i]);
+	}
+
+	/* If the system is flat along an axis, everything maps onto 0. */
+	const auto grid = static_cast<double>((1 << bits) - 1);
+	const auto scale = [&](double low, double high) {
+		return high > low? grid / (high - low): 0.0;
+	};
+
+	const auto scale_x = scale(min.x, max.x);
+	const auto scale_y = scale(min.y, max.y);
+	const auto scale_z = scale(min.z, max.z);
+
+	/* Compute the key for every entity and sort the rows by them. */
+	std::vector<std::pair<uint64_t, size_t>> keys(total);
+
+	for(size_t i = 0; i < total; i++) {
+		const auto x = static_cast<uint32_t>((xs[i] - min.x) * scale_x);
+		const auto y = static_cast<uint32_t>((ys[i] - min.y) * scale_y);
+		const auto z = static_cast<uint32_t>((zs[i] - min.z) * scale_z);
+
+		if constexpr(hilbert) keys[i] = {hilbert_key(x, y, z), i};
+		else keys[i] = {morton_key(x, y, z), i};
+	}
+
+	std::sort(keys.begin(), keys.end());
+
+	/* The sorted rows are the new order of the database. */
+	std::vector<size_t> order(total);
+
+	for(size_t i = 0; i < total; i++) {
+		order[i] = keys[i].second;
+	}
+
+	s -> database_reorder(order);
+}
+
+static uint64_t morton_key(uint32_t x, uint32_t y, uint32_t z) {
+	/* Interleave the bits of the coordinates. */
+	return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+}
+
+static uint64_t hilbert_key(uint32_t x, uint32_t y, uint32_t z) {
+	/* This is John Skilling's algorithm for converting coordinates into
+	 * the transposed form of the Hilbert index, see footnote [1]. */
+	uint32_t X[3] = {x, y, z};
+	const uint32_t M = 1u << (bits - 1);
+
+	/* Undo the excess work of the inverse transform. */
+	for(uint32_t Q = M; Q > 1; Q >>= 1) {
+		const uint32_t P = Q - 1;
+
+		for(size_t i = 0; i < 3; i++) {
+			if(X[i] & Q) {
+				X[0] ^= P; // Invert the low bits of X[0].
+			}
+
+			else {
+				const auto t = (X[0] ^ X[i]) & P;
+				X[0] ^= t; X[i] ^= t; // Exchange the low bits.
+			}
+		}
+	}
+
+	/* Gray encode the result. */
+	X[1] ^= X[0];
+	X[2] ^= X[1];
+
+	uint32_t t = 0;
+	for(uint32_t Q = M; Q > 1; Q >>= 1) {
+		if(X[2] & Q) t ^= Q - 1;
+	}
+
+	X[0] ^= t; X[1] ^= t; X[2] ^= t;
+
+	/* In the transposed form, the most significant bit of the index is
+	 * the most significant bit of the first axis, and so on. */
+	return (spread(X[0]) << 2) | (spread(X[1]) << 1) | spread(X[2]);
+}
+
+static uint64_t spread(uint64_t v) {
+	/* Each step moves half of the remaining groups of bits upwards, see
+	 * footnote [2] for the derivation of the masks. */
+	v &= 0x1fffff;
+	v = (v | (v << 32)) & 0x1f00000000ffff;
+	v = (v | (v << 16)) & 0x1f0000ff0000ff;
+	v = (v | (v << 8))  & 0x100f00f00f00f00f;
+	v = (v | (v << 4))  & 0x10c30c30c30c30c3;
+	v = (v | (v << 2))  & 0x1249249249249249;
+
+	return v;
+}
+
+/* [1] J. Skilling, "Programming the Hilbert curve", AIP Conference
+ *     Proceedings 707, 381 (2004).
+ * [2] <https://graphics.stanford.edu/~seander/bithacks.html> */
\ No newline at end of file
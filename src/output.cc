@@ -0,0 +1,911 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+/* Including System Headerfiles */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl/io.h>
+#include <libSphysl/output.h>
+#include <libSphysl/utility.h>
+
+/* Structure Declarations */
+
+/* Every source file has its own arg_t, so they're kept in an anonymous
+ * namespace to stop the linker from merging their destructor<arg_t>'s. */
+namespace {
+
+/* This is the argument that's going to be passed to the calculator. */
+struct arg_t {
+	libSphysl::sandbox_t* s; // The sandbox we're logging.
+
+	const size_t& tick; // Current simulation tick.
+	const double& time; // Current simulation time.
+	const size_t& count; // Number of entities.
+	const size_t& interval; // Number of ticks between frames.
+
+	const std::list<std::string> columns; // What we're logging.
+
+	/* Whatever's left in the buffer gets written out when the writer's
+	 * destroyed. */
+	libSphysl::io::writer_t writer;
+};
+
+/* For compressed trajectories, there's one of these for every column, so that
+ * the columns can be encoded in parallel. */
+struct column_arg_t {
+	libSphysl::sandbox_t* s; // The sandbox we're logging.
+	const std::string id; // The column we're encoding.
+	const double scale; // Reciprocal of the quantisation step.
+
+	const size_t& tick; // Current simulation tick.
+	const size_t& count; // Number of entities.
+	const size_t& interval; // Number of ticks between frames.
+	const size_t& keyframes; // Number of frames between keyframes.
+	const size_t& frames; // Number of frames written so far.
+
+	std::vector<std::int64_t> previous; // Rounded values last frame.
+	std::string encoded; // The encoded values for this frame.
+};
+
+/* The encoded columns are then put together into a frame by this one. */
+struct frame_arg_t {
+	const size_t& tick; // Current simulation tick.
+	const double& time; // Current simulation time.
+	const size_t& count; // Number of entities.
+	const size_t& interval; // Number of ticks between frames.
+
+	std::vector<const column_arg_t*> columns; // In the order of the file.
+	size_t frames; // Number of frames written so far.
+
+	libSphysl::io::writer_t writer;
+};
+
+/* This is the argument for publishing frames to viewers. */
+struct ring_arg_t {
+	libSphysl::sandbox_t* s; // The sandbox we're showing.
+
+	const size_t& tick; // Current simulation tick.
+	const double& time; // Current simulation time.
+	const size_t& count; // Number of entities.
+	const size_t& interval; // Number of ticks between frames.
+
+	const std::list<std::string> columns; // What we're showing.
+	const std::string name; // Name of the shared memory.
+
+	char* data; // The mapped shared memory.
+	size_t size; // bytes
+
+	~ring_arg_t() {
+		/* Viewers that still have it mapped can keep reading it. */
+		munmap(this -> data, this -> size);
+		shm_unlink(this -> name.c_str());
+	}
+};
+
+}
+
+/* Constants Declarations */
+
+static const uint64_t magic = 0x52546c7379687053; // "SphyslTR"
+static const uint64_t compressed_magic = 0x5a546c7379687053; // "SphyslTZ"
+static const uint64_t ring_magic = 0x42526c7379687053; // "SphyslRB"
+static const uint64_t format = 1;
+
+/* There are this many slots in a ring, each aligned to a page. */
+static const size_t slots = 4;
+static const size_t page_size = 4096;
+
+/* Compressed columns are bit-packed in blocks of this many entities, and the
+ * rounded values are clamped to this magnitude, the largest double below 2^62,
+ * so that the differences between them stay below 2^63 and can't overflow. */
+static const size_t block_size = 64;
+static const double limit = 4611686018427387392.0; // 2^62 - 512
+
+/* Frames are gathered into buffers of at least this many bytes before they're
+ * handed over to be written. */
+static const size_t buffer_size = size_t{1} << 24;
+
+/* Function Declarations */
+
+/* These are the calculators that we will be using for the engines. */
+static void calculator(void* arg);
+static void encoder(void* arg);
+static void assembler(void* arg);
+static void publisher(void* arg);
+
+/* These pack and unpack a block of values with the given width in bits. */
+static void pack(
+	std::string& buffer, const uint64_t* values, size_t count,
+	unsigned width
+);
+
+static void unpack(
+	const char* data, uint64_t* values, size_t count, unsigned width
+);
+
+/* This appends a value or the contents of a column to the buffer. */
+template<typename T> static void put(
+	libSphysl::io::buffer_t& buffer, const T& value
+);
+
+static void put(libSphysl::io::buffer_t& buffer, const std::string& value);
+
+static void put_column(
+	libSphysl::io::buffer_t& buffer, libSphysl::sandbox_t* s,
+	const std::string& id, size_t count
+);
+
+/* Function Definitions */
+
+libSphysl::engine_t libSphysl::output::trajectory(
+	libSphysl::sandbox_t* s, const std::string& path,
+	const std::list<std::string>& columns
+){
+	/* The engine we're generating. */
+	libSphysl::engine_t engine;
+
+	engine.calculator = calculator;
+	engine.destructor = libSphysl::utility::destructor<arg_t>;
+
+	/* Get the variables we need from the config. */
+	const auto& tick = std::get<size_t>(s -> config_get("simulation tick"));
+	const auto& time = std::get<double>(s -> config_get("time"));
+	const auto& count = std::get<size_t>(s -> config_get("entity count"));
+
+	const auto& interval = std::get<size_t>(
+		s -> config_get("output interval")
+	);
+
+	if(!interval) throw std::invalid_argument(
+		"the output interval must be at least 1"
+	);
+
+	const auto direct = std::get<bool>(s -> config_get("direct output"));
+
+	/* Work out the types of the columns for the header of the file. */
+	libSphysl::io::buffer_t header;
+	put(header, magic);
+	put(header, format);
+	put(header, uint64_t{columns.size()});
+
+	for(const auto& id: columns) {
+		/* Aliases of packed axes are always doubles. */
+		size_t type = libSphysl::data_vector_t(
+			libSphysl::column_t<double>{}
+		).index();
+
+		if(!s -> axes.count(id)) {
+			const auto& column = s -> database_get(id);
+			type = column.index();
+
+			if(std::holds_alternative<
+				libSphysl::column_t<libSphysl::binary_t>
+			>(column)) throw std::invalid_argument(
+				"can't log binary_t column '" + id + "'"
+			);
+		}
+
+		put(header, id);
+		put(header, uint64_t{type});
+	}
+
+	/* Only one calculation in this engine; return the generated engine.
+	 * The columns are looked up for every frame, since that's cheap next
+	 * to copying them, so we don't need to be regenerated. */
+	auto arg = new arg_t{
+		s, tick, time, count, interval, columns, {path, direct}
+	};
+
+	arg -> writer.buffer.append(header);
+
+	engine.args.push_back(reinterpret_cast<void*>(arg));
+	return engine;
+}
+
+std::list<libSphysl::engine_t> libSphysl::output::compressed(
+	libSphysl::sandbox_t* s, const std::string& path,
+	const std::map<std::string, double>& columns
+){
+	/* The engines we're generating; one to encode the columns and one to
+	 * put them together into frames. */
+	libSphysl::engine_t encoders, assemblers;
+
+	encoders.calculator = encoder;
+	encoders.destructor = libSphysl::utility::destructor<column_arg_t>;
+
+	assemblers.calculator = assembler;
+	assemblers.destructor = libSphysl::utility::destructor<frame_arg_t>;
+
+	/* Get the variables we need from the config. */
+	const auto& tick = std::get<size_t>(s -> config_get("simulation tick"));
+	const auto& time = std::get<double>(s -> config_get("time"));
+	const auto& count = std::get<size_t>(s -> config_get("entity count"));
+
+	const auto& interval = std::get<size_t>(
+		s -> config_get("output interval")
+	);
+
+	if(!interval) throw std::invalid_argument(
+		"the output interval must be at least 1"
+	);
+
+	const auto direct = std::get<bool>(s -> config_get("direct output"));
+
+	const auto& keyframes = std::get<size_t>(
+		s -> config_get("keyframe interval")
+	);
+
+	if(!keyframes) throw std::invalid_argument(
+		"the keyframe interval must be at least 1"
+	);
+
+	/* Check the columns and write the header of the file. */
+	libSphysl::io::buffer_t header;
+	put(header, compressed_magic);
+	put(header, format);
+	put(header, uint64_t{columns.size()});
+
+	for(const auto& [id, tolerance]: columns) {
+		if(!s -> axes.count(id) && !std::holds_alternative<
+			libSphysl::column_t<double>
+		>(s -> database_get(id))) throw std::invalid_argument(
+			"can't compress non-double column '" + id + "'"
+		);
+
+		if(!(tolerance > 0.0)) throw std::invalid_argument(
+			"tolerance for column '" + id + "' isn't positive"
+		);
+
+		put(header, id);
+		put(header, tolerance);
+	}
+
+	auto frame = new frame_arg_t{
+		tick, time, count, interval, {}, 0, {path, direct}
+	};
+
+	frame -> writer.buffer.append(header);
+
+	/* Rounding to multiples of twice the tolerance keeps the error within
+	 * the tolerance. */
+	for(const auto& [id, tolerance]: columns) {
+		auto arg = new column_arg_t{
+			s, id, 0.5 / tolerance, tick, count, interval,
+			keyframes, frame -> frames, {}, {}
+		};
+
+		frame -> columns.push_back(arg);
+		encoders.args.push_back(reinterpret_cast<void*>(arg));
+	}
+
+	/* The columns are looked up for every frame, like in trajectory(), so
+	 * we don't need to be regenerated either. */
+	assemblers.args.push_back(reinterpret_cast<void*>(frame));
+	return {encoders, assemblers};
+}
+
+libSphysl::engine_t libSphysl::output::ring(
+	libSphysl::sandbox_t* s, const std::string& name,
+	const std::list<std::string>& columns
+){
+	/* The engine we're generating. */
+	libSphysl::engine_t engine;
+
+	engine.calculator = publisher;
+	engine.destructor = libSphysl::utility::destructor<ring_arg_t>;
+
+	/* Get the variables we need from the config. */
+	const auto& tick = std::get<size_t>(s -> config_get("simulation tick"));
+	const auto& time = std::get<double>(s -> config_get("time"));
+	const auto& count = std::get<size_t>(s -> config_get("entity count"));
+
+	const auto& interval = std::get<size_t>(
+		s -> config_get("viewer interval")
+	);
+
+	if(!interval) throw std::invalid_argument(
+		"the viewer interval must be at least 1"
+	);
+
+	/* Check the columns and work out how much room the ids need. */
+	size_t offset = sizeof(libSphysl::output::ring_t);
+
+	for(const auto& id: columns) {
+		if(!s -> axes.count(id) && !std::holds_alternative<
+			libSphysl::column_t<double>
+		>(s -> database_get(id))) throw std::invalid_argument(
+			"can't show non-double column '" + id + "'"
+		);
+
+		offset += id.size() + 1;
+	}
+
+	const auto round = [](size_t bytes) {
+		return (bytes + page_size - 1) / page_size * page_size;
+	};
+
+	offset = round(offset);
+	const auto slot_size = round(
+		sizeof(libSphysl::output::slot_t)
+		+ columns.size() * count * sizeof(double)
+	);
+
+	const auto size = offset + slots * slot_size;
+
+	/* Create the shared memory, getting rid of any that was left behind by
+	 * a simulation that didn't finish. */
+	shm_unlink(name.c_str());
+	const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+
+	const auto fail = [&](const std::string& what) {
+		const std::string error = std::strerror(errno);
+		if(fd != -1) close(fd);
+		shm_unlink(name.c_str());
+
+		throw std::runtime_error(
+			"couldn't " + what + " '" + name + "': " + error
+		);
+	};
+
+	if(fd == -1) fail("create");
+	if(ftruncate(fd, size) == -1) fail("resize");
+
+	auto data = reinterpret_cast<char*>(mmap(
+		nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+	));
+
+	if(data == MAP_FAILED) fail("map");
+	close(fd);
+
+	/* Fill in the header. The memory starts out zeroed, so the slots only
+	 * need to be constructed. */
+	auto ring = new(data) libSphysl::output::ring_t;
+	ring -> magic = ring_magic;
+	ring -> format = format;
+	ring -> slots = slots;
+	ring -> capacity = count;
+	ring -> columns = columns.size();
+	ring -> offset = offset;
+	ring -> slot_size = slot_size;
+	ring -> latest.store(0);
+
+	auto ids = data + sizeof(libSphysl::output::ring_t);
+	for(const auto& id: columns) {
+		std::memcpy(ids, id.c_str(), id.size() + 1);
+		ids += id.size() + 1;
+	}
+
+	for(size_t i = 0; i < slots; i++) {
+		auto slot = new(data + offset + i * slot_size)
+			libSphysl::output::slot_t;
+
+		slot -> sequence.store(0);
+	}
+
+	/* The columns are looked up for every frame, like in trajectory(), so
+	 * we don't need to be regenerated either. */
+	auto arg = new ring_arg_t{
+		s, tick, time, count, interval, columns, name, data, size
+	};
+
+	engine.args.push_back(reinterpret_cast<void*>(arg));
+	return engine;
+}
+
+static void calculator(void* arg) {
+	/* Get a reference to our cached data by casting the argument. If the
+	 * interval has since been set to 0, nothing is written. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	if(!data.interval || data.tick % data.interval) return;
+
+	/* Leave room for the size of the frame and fill it in at the end. */
+	auto& buffer = data.writer.buffer;
+	const auto start = buffer.size();
+
+	put(buffer, uint64_t{0});
+	put(buffer, uint64_t{data.tick});
+	put(buffer, data.time);
+	put(buffer, uint64_t{data.count});
+
+	for(const auto& id: data.columns) {
+		put_column(buffer, data.s, id, data.count);
+	}
+
+	const uint64_t size = buffer.size() - start;
+	std::memcpy(&buffer[start], &size, sizeof(size));
+
+	if(buffer.size() >= buffer_size) data.writer.flush();
+}
+
+static void encoder(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<column_arg_t*>(arg);
+	if(!data.interval || data.tick % data.interval) return;
+
+	const auto count = data.count;
+	auto values = libSphysl::utility::get_axis(data.s, data.id, 0, count);
+
+	/* Keyframes are encoded as differences from 0, and every frame is
+	 * one if the keyframe interval has since been set to 0. */
+	const bool keyframe = !data.keyframes || !(data.frames % data.keyframes)
+		|| data.previous.size() != count;
+
+	if(keyframe) data.previous.assign(count, 0);
+
+	auto& encoded = data.encoded;
+	encoded.clear();
+	encoded.push_back(keyframe);
+
+	uint64_t block[block_size];
+
+	for(size_t i = 0; i < count; i += block_size) {
+		const auto n = std::min(block_size, count - i);
+		uint64_t bits = 0;
+
+		for(size_t j = 0; j < n; j++) {
+			/* Round the value and clamp it so it fits. */
+			auto value = values[i + j] * data.scale;
+			if(std::isnan(value)) value = 0.0;
+			value = std::clamp(value, -limit, limit);
+
+			const std::int64_t rounded = std::llround(value);
+			const auto delta = rounded - data.previous[i + j];
+			data.previous[i + j] = rounded;
+
+			/* Zigzag encoding keeps small negatives small. */
+			block[j] = (static_cast<uint64_t>(delta) << 1)
+				^ static_cast<uint64_t>(delta >> 63);
+
+			bits |= block[j];
+		}
+
+		/* The width is the position of the highest set bit. */
+		unsigned width = 0;
+		while(width < 64 && bits >> width) width++;
+
+		pack(encoded, block, n, width);
+	}
+}
+
+static void assembler(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<frame_arg_t*>(arg);
+	if(!data.interval || data.tick % data.interval) return;
+
+	/* Leave room for the size of the frame and fill it in at the end. */
+	auto& buffer = data.writer.buffer;
+	const auto start = buffer.size();
+
+	put(buffer, uint64_t{0});
+	put(buffer, uint64_t{data.tick});
+	put(buffer, data.time);
+	put(buffer, uint64_t{data.count});
+
+	for(const auto& i: data.columns) {
+		put(buffer, uint64_t{i -> encoded.size()});
+		buffer.append(i -> encoded.data(), i -> encoded.size());
+	}
+
+	const uint64_t size = buffer.size() - start;
+	std::memcpy(&buffer[start], &size, sizeof(size));
+
+	data.frames++;
+	if(buffer.size() >= buffer_size) data.writer.flush();
+}
+
+static void publisher(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<ring_arg_t*>(arg);
+	if(!data.interval || data.tick % data.interval) return;
+
+	auto& ring = *reinterpret_cast<libSphysl::output::ring_t*>(data.data);
+	const auto frame = ring.latest.load(std::memory_order_relaxed) + 1;
+
+	auto start = data.data + ring.offset
+		+ frame % ring.slots * ring.slot_size;
+
+	auto& slot = *reinterpret_cast<libSphysl::output::slot_t*>(start);
+	auto values = reinterpret_cast<double*>(
+		start + sizeof(libSphysl::output::slot_t)
+	);
+
+	/* Mark the slot as being written; the fence stops the writes below
+	 * from being seen before the mark is. */
+	const auto sequence = slot.sequence.load(std::memory_order_relaxed);
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	const auto count = std::min(data.count, size_t{ring.capacity});
+	slot.tick = data.tick;
+	slot.count = count;
+	slot.time = data.time;
+
+	for(const auto& id: data.columns) {
+		/* Packed axes have to be gathered one value at a time. */
+		if(data.s -> axes.count(id)) {
+			auto axis = libSphysl::utility::get_axis(
+				data.s, id, 0, count
+			);
+
+			for(size_t i = 0; i < count; i++) values[i] = axis[i];
+		}
+
+		else std::memcpy(values, std::get<libSphysl::column_t<double>>(
+			data.s -> database.at(id)
+		).data(), count * sizeof(double));
+
+		values += ring.capacity;
+	}
+
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+	ring.latest.store(frame, std::memory_order_release);
+}
+
+static void pack(
+	std::string& buffer, const uint64_t* values, size_t count,
+	unsigned width
+){
+	buffer.push_back(width);
+
+	/* Gather the bits into a 64-bit word and write it out a byte at a time
+	 * whenever it fills up, least significant byte first. */
+	uint64_t word = 0;
+	unsigned used = 0;
+
+	const auto flush = [&](unsigned bits) {
+		for(unsigned i = 0; i < bits; i += 8) {
+			buffer.push_back(static_cast<char>(word >> i));
+		}
+
+		word = 0; used = 0;
+	};
+
+	for(size_t i = 0; i < count; i++) {
+		auto value = values[i];
+		unsigned left = width;
+
+		while(left) {
+			const auto bits = std::min(left, 64 - used);
+			const auto mask = bits == 64? ~uint64_t{0}:
+				(uint64_t{1} << bits) - 1;
+
+			word |= (value & mask) << used;
+			value = bits == 64? 0: value >> bits;
+
+			used += bits;
+			left -= bits;
+
+			if(used == 64) flush(64);
+		}
+	}
+
+	if(used) flush(used);
+}
+
+static void unpack(
+	const char* data, uint64_t* values, size_t count, unsigned width
+){
+	/* Read the bits back in the same order, a byte at a time. */
+	size_t bit = 0;
+
+	for(size_t i = 0; i < count; i++) {
+		uint64_t value = 0;
+
+		for(unsigned got = 0; got < width;) {
+			const auto byte = static_cast<unsigned char>(
+				data[bit / 8]
+			);
+
+			const auto offset = bit % 8;
+			const auto bits = std::min(
+				8 - offset, size_t{width - got}
+			);
+
+			const uint64_t part = (byte >> offset)
+				& ((1u << bits) - 1);
+
+			value |= part << got;
+			got += bits;
+			bit += bits;
+		}
+
+		values[i] = value;
+	}
+}
+
+template<typename T> static void put(
+	libSphysl::io::buffer_t& buffer, const T& value
+){
+	buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void put(libSphysl::io::buffer_t& buffer, const std::string& value) {
+	put(buffer, uint64_t{value.size()});
+	buffer.append(value.data(), value.size());
+}
+
+static void put_column(
+	libSphysl::io::buffer_t& buffer, libSphysl::sandbox_t* s,
+	const std::string& id, size_t count
+){
+	/* Packed axes have to be gathered one value at a time. */
+	if(s -> axes.count(id)) {
+		auto values = libSphysl::utility::get_axis(s, id, 0, count);
+		for(size_t i = 0; i < count; i++) put(buffer, values[i]);
+		return;
+	}
+
+	std::visit([&](const auto& vec) {
+		typedef typename std::decay_t<decltype(vec)>::value_type T;
+
+		/* Booleans are packed into bits in a std::vector, so they're
+		 * expanded into bytes, and binary_t's were ruled out when the
+		 * engine was generated. */
+		if constexpr(std::is_same_v<T, bool>) {
+			for(const auto i: vec) buffer.push_back(i);
+		}
+
+		else if constexpr(!std::is_same_v<T, libSphysl::binary_t>) {
+			buffer.append(
+				reinterpret_cast<const char*>(vec.data()),
+				vec.size() * sizeof(T)
+			);
+		}
+	}, s -> database.at(id));
+}
+
+libSphysl::output::decoder_t::decoder_t(const std::string& path):
+	file{path, std::ios::binary}
+{
+	if(!this -> file) throw std::runtime_error(
+		"couldn't open '" + path + "' for reading"
+	);
+
+	/* Read the header and set up the columns. */
+	const auto get = [&]() {
+		uint64_t value = 0;
+		auto bytes = reinterpret_cast<char*>(&value);
+		this -> file.read(bytes, sizeof(value));
+		return value;
+	};
+
+	if(get() != compressed_magic || get() != format) {
+		throw std::runtime_error(
+			"'" + path + "' isn't a compressed libSphysl trajectory"
+		);
+	}
+
+	this -> columns.resize(get());
+
+	for(auto& [id, tolerance]: this -> columns) {
+		id.resize(get());
+		this -> file.read(id.data(), id.size());
+		this -> file.read(
+			reinterpret_cast<char*>(&tolerance), sizeof(tolerance)
+		);
+	}
+
+	if(!this -> file) throw std::runtime_error(
+		"'" + path + "' is truncated"
+	);
+}
+
+bool libSphysl::output::decoder_t::next(libSphysl::output::frame_t& frame) {
+	/* Read the whole frame into the buffer. */
+	uint64_t size = 0;
+	this -> file.read(reinterpret_cast<char*>(&size), sizeof(size));
+	if(!this -> file) return false;
+
+	const auto header = 4 * sizeof(uint64_t);
+	if(size < header) throw std::runtime_error("trajectory is corrupt");
+
+	auto& buffer = this -> buffer;
+	buffer.resize(size - sizeof(size));
+	this -> file.read(buffer.data(), buffer.size());
+	if(!this -> file) throw std::runtime_error("trajectory is truncated");
+
+	size_t offset = 0;
+	const auto take = [&](size_t bytes) {
+		if(bytes > buffer.size() - offset) throw std::runtime_error(
+			"trajectory is corrupt"
+		);
+
+		offset += bytes;
+		return buffer.data() + offset - bytes;
+	};
+
+	const auto get = [&]() {
+		uint64_t value;
+		std::memcpy(&value, take(sizeof(value)), sizeof(value));
+		return value;
+	};
+
+	frame.tick = get();
+	std::memcpy(&frame.time, take(sizeof(double)), sizeof(double));
+	frame.count = get();
+
+	/* Undo the encoding of each column. */
+	uint64_t block[block_size];
+
+	for(const auto& [id, tolerance]: this -> columns) {
+		const auto end = offset + get();
+		const bool keyframe = *take(1);
+
+		auto& previous = this -> previous[id];
+		auto& values = frame.columns[id];
+
+		if(keyframe) previous.assign(frame.count, 0);
+		else if(previous.size() != frame.count) {
+			throw std::runtime_error("trajectory is corrupt");
+		}
+
+		values.resize(frame.count);
+		const auto step = 2.0 * tolerance;
+
+		for(size_t i = 0; i < frame.count; i += block_size) {
+			const auto n = std::min(block_size, frame.count - i);
+			const unsigned width = static_cast<unsigned char>(
+				*take(1)
+			);
+
+			if(width > 64) throw std::runtime_error(
+				"trajectory is corrupt"
+			);
+
+			unpack(take((n * width + 7) / 8), block, n, width);
+
+			for(size_t j = 0; j < n; j++) {
+				const auto delta = static_cast<std::int64_t>(
+					(block[j] >> 1) ^ (~(block[j] & 1) + 1)
+				);
+
+				previous[i + j] += delta;
+				values[i + j] = previous[i + j] * step;
+			}
+		}
+
+		if(offset != end) throw std::runtime_error(
+			"trajectory is corrupt"
+		);
+	}
+
+	return true;
+}
+
+libSphysl::output::viewer_t::viewer_t(const std::string& name) {
+	const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+
+	if(fd == -1) throw std::runtime_error(
+		"couldn't open '" + name + "': " + std::strerror(errno)
+	);
+
+	struct stat info;
+	if(fstat(fd, &info) == -1) info.st_size = 0;
+	this -> size = info.st_size;
+
+	auto data = MAP_FAILED;
+	if(this -> size >= sizeof(libSphysl::output::ring_t)) data = mmap(
+		nullptr, this -> size, PROT_READ, MAP_SHARED, fd, 0
+	);
+
+	close(fd);
+
+	if(data == MAP_FAILED) throw std::runtime_error(
+		"couldn't map '" + name + "'"
+	);
+
+	this -> data = reinterpret_cast<const char*>(data);
+
+	/* Check the header and read the ids of the columns. */
+	const auto& ring = *reinterpret_cast<const libSphysl::output::ring_t*>(
+		this -> data
+	);
+
+	const auto slot_size = sizeof(libSphysl::output::slot_t)
+		+ ring.columns * ring.capacity * sizeof(double);
+
+	if(ring.magic != ring_magic || ring.format != format || !ring.slots
+		|| ring.slot_size < slot_size || ring.offset > this -> size
+		|| (this -> size - ring.offset) / ring.slots < ring.slot_size
+	){
+		munmap(data, this -> size);
+		throw std::runtime_error(
+			"'" + name + "' isn't a libSphysl ring"
+		);
+	}
+
+	auto ids = this -> data + sizeof(libSphysl::output::ring_t);
+	const auto end = this -> data + ring.offset;
+
+	for(size_t i = 0; i < ring.columns; i++) {
+		const auto length = strnlen(ids, end - ids);
+
+		if(ids + length == end) {
+			munmap(data, this -> size);
+			throw std::runtime_error("'" + name + "' is corrupt");
+		}
+
+		this -> columns.emplace_back(ids, length);
+		ids += length + 1;
+	}
+}
+
+libSphysl::output::viewer_t::~viewer_t() {
+	munmap(const_cast<char*>(this -> data), this -> size);
+}
+
+bool libSphysl::output::viewer_t::read(libSphysl::output::frame_t& frame) {
+	const auto& ring = *reinterpret_cast<const libSphysl::output::ring_t*>(
+		this -> data
+	);
+
+	while(true) {
+		const auto latest = ring.latest.load(std::memory_order_acquire);
+		if(latest == this -> last) return false;
+
+		const auto start = this -> data + ring.offset
+			+ latest % ring.slots * ring.slot_size;
+
+		const auto& slot = *reinterpret_cast<
+			const libSphysl::output::slot_t*
+		>(start);
+
+		auto values = reinterpret_cast<const double*>(
+			start + sizeof(libSphysl::output::slot_t)
+		);
+
+		/* If the slot is being written, try again. */
+		const auto sequence = slot.sequence.load(
+			std::memory_order_acquire
+		);
+
+		if(sequence & 1) continue;
+
+		/* The count could be torn, so keep it in bounds until we know
+		 * it isn't. */
+		frame.tick = slot.tick;
+		frame.count = std::min(slot.count, ring.capacity);
+		frame.time = slot.time;
+
+		for(const auto& id: this -> columns) {
+			frame.columns[id].assign(values, values + frame.count);
+			values += ring.capacity;
+		}
+
+		/* If it was written while we were copying it, try again. */
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(slot.sequence.load(std::memory_order_relaxed) != sequence) {
+			continue;
+		}
+
+		this -> last = latest;
+		return true;
+	}
+}
@@ -0,0 +1,224 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl/potentials.h>
+#include <libSphysl/utility.h>
+
+/* Structure Declarations */
+
+/* Every source file has its own arg_t, so they're kept in an anonymous
+ * namespace to stop the linker from merging their destructor<arg_t>'s. */
+namespace {
+
+/* There's one of these for every force partition. */
+struct arg_t {
+	std::shared_ptr<libSphysl::utility::neighbours_t> neighbours;
+	std::shared_ptr<libSphysl::utility::forces_t> forces;
+
+	size_t partition, start, stop; // The first entities of our pairs.
+	libSphysl::utility::slice_t<double> x, y, z; // Positions.
+
+	/* The Lennard-Jones parameters, or the force_t for the rest. */
+	const double *epsilon, *sigma;
+	libSphysl::potentials::force_t force;
+};
+
+}
+
+/* Function Declarations */
+
+/* This sets up the engines for either of the potentials, the Lennard-Jones
+ * one if force is empty. */
+static std::list<libSphysl::engine_t> generator(
+	libSphysl::sandbox_t* s, const libSphysl::potentials::force_t& force,
+	double cutoff
+);
+
+/* These are the calculators for the Lennard-Jones potential and for the
+ * rest. */
+static void lennard_jones(void* arg);
+static void pairwise(void* arg);
+
+/* This goes through our pairs and adds up their forces, given a function that
+ * gives the force over the distance from the square of the distance. */
+
+template<typename T> static void accumulate(arg_t& data, T over);
+
+/* Function Definitions */
+
+std::list<libSphysl::engine_t> libSphysl::potentials::lennard_jones(
+	libSphysl::sandbox_t* s
+){
+	const auto cutoff = std::get<double>(
+		s -> config_get("lennard-jones cutoff")
+	);
+
+	return generator(s, {}, cutoff);
+}
+
+std::list<libSphysl::engine_t> libSphysl::potentials::pairwise(
+	libSphysl::sandbox_t* s, const force_t& force, double cutoff
+){
+	if(!force) throw std::invalid_argument("the force can't be empty");
+	return generator(s, force, cutoff);
+}
+
+static std::list<libSphysl::engine_t> generator(
+	libSphysl::sandbox_t* s, const libSphysl::potentials::force_t& force,
+	double cutoff
+){
+	/* Get the variables we need from the config. */
+	const auto total = std::get<size_t>(s -> config_get("entity count"));
+
+	const auto& epsilon = std::get<double>(
+		s -> config_get("lennard-jones epsilon")
+	);
+
+	const auto& sigma = std::get<double>(
+		s -> config_get("lennard-jones sigma")
+	);
+
+	const auto skin = std::get<double>(s -> config_get("neighbour skin"));
+
+	/* The list of neighbours is kept up to date by its own engines, which
+	 * run first, and the forces are added up by another engine after
+	 * ours. This throws std::invalid_argument for us if the cutoff or the
+	 * skin don't make sense. */
+	auto neighbours = libSphysl::utility::make_neighbours(
+		s, cutoff, skin * cutoff
+	);
+
+	auto forces = libSphysl::utility::make_forces(s);
+
+	auto engines = libSphysl::utility::update_neighbours(s, neighbours);
+
+	/* Split the pairs into the partitions by their first entities. */
+	libSphysl::engine_t engine;
+
+	engine.calculator = force? pairwise: lennard_jones;
+	engine.destructor = libSphysl::utility::destructor<arg_t>;
+
+	const auto ranges = libSphysl::utility::divide_range(
+		0, total, forces -> partitions
+	);
+
+	for(size_t i = 0; i < ranges.size(); i++) {
+		const auto [start, stop] = ranges[i];
+		if(start == stop) continue;
+
+		auto arg = new arg_t{
+			neighbours, forces, i, start, stop,
+
+			libSphysl::utility::get_axis(s, "x position", 0, total),
+			libSphysl::utility::get_axis(s, "y position", 0, total),
+			libSphysl::utility::get_axis(s, "z position", 0, total),
+
+			&epsilon, &sigma, force
+		};
+
+		engine.args.push_back(reinterpret_cast<void*>(arg));
+	}
+
+	engines.push_back(engine);
+	engines.push_back(libSphysl::utility::reduce_forces(s, forces));
+
+	/* If the database is changed, we are regenerated the same way. */
+	if(force) engines.front().generator = [force, cutoff](
+		libSphysl::sandbox_t* s
+	){
+		return libSphysl::potentials::pairwise(s, force, cutoff);
+	};
+
+	else engines.front().generator = [](libSphysl::sandbox_t* s) {
+		return libSphysl::potentials::lennard_jones(s);
+	};
+
+	engines.front().span = engines.size();
+	return engines;
+}
+
+static void lennard_jones(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+
+	/* The force over the distance is 24 epsilon (2 (sigma / r)^12 -
+	 * (sigma / r)^6) / r^2. */
+	const auto epsilon_24 = 24.0 * *data.epsilon;
+	const auto sigma_sq = *data.sigma * *data.sigma;
+
+	accumulate(data, [&](double r_sq) {
+		const auto s_2 = sigma_sq / r_sq;
+		const auto s_6 = s_2 * s_2 * s_2;
+
+		return epsilon_24 * s_6 * (2.0 * s_6 - 1.0) / r_sq;
+	});
+}
+
+static void pairwise(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+
+	accumulate(data, [&](double r_sq) {
+		const auto r = std::sqrt(r_sq);
+		return data.force(r) / r;
+	});
+}
+
+template<typename T> static void accumulate(arg_t& data, T over) {
+	const auto& neighbours = *data.neighbours;
+	auto forces = data.forces -> partition(data.partition);
+
+	/* The list holds the pairs within the cutoff plus the skin, so the
+	 * ones further apart than the cutoff are skipped. */
+	const auto cutoff_sq = neighbours.cutoff * neighbours.cutoff;
+
+	for(auto i = data.start; i < data.stop; i++) {
+		const libSphysl::vec3_t p{data.x[i], data.y[i], data.z[i]};
+		libSphysl::vec3_t F{0.0, 0.0, 0.0};
+
+		for(auto k = neighbours.offsets[i];
+			k < neighbours.offsets[i + 1]; k++
+		){
+			const auto j = neighbours.indices[k];
+
+			const auto d_x = p.x - data.x[j];
+			const auto d_y = p.y - data.y[j];
+			const auto d_z = p.z - data.z[j];
+
+			const auto r_sq = d_x * d_x + d_y * d_y + d_z * d_z;
+			if(r_sq >= cutoff_sq || r_sq == 0.0) continue;
+
+			/* The force pushes i away from j if it's positive, and
+			 * j the other way. */
+			const auto f = over(r_sq);
+
+			F.x += f * d_x; F.y += f * d_y; F.z += f * d_z;
+
+			auto& G = forces[j];
+			G.x -= f * d_x; G.y -= f * d_y; G.z -= f * d_z;
+		}
+
+		auto& G = forces[i];
+		G.x += F.x; G.y += F.y; G.z += F.z;
+	}
+}
@@ -0,0 +1,218 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl/statistics.h>
+#include <libSphysl/utility.h>
+
+/* Structure Declarations */
+
+/* Every source file has its own arg_t, so they're kept in an anonymous
+ * namespace to stop the linker from merging their destructor<arg_t>'s. */
+namespace {
+
+/* This is what a block (or a number of blocks) of a column reduces to. */
+struct partial_t {
+	double minimum, maximum, sum;
+};
+
+/* There's one of these for every block of entities. */
+struct arg_t {
+	std::vector<libSphysl::utility::slice_t<double>> columns;
+	size_t count; // Number of entities in the block.
+
+	partial_t* partials; // Where this block's results go, one per column.
+	size_t stride; // Distance between the results for each column.
+};
+
+/* The results for the blocks are then combined by this one. */
+struct combine_arg_t {
+	const size_t count; // Number of entities.
+	const size_t blocks; // Number of blocks.
+
+	/* The results for each block, grouped by column. */
+	std::vector<partial_t> partials;
+
+	/* The config values for each column. */
+	std::vector<std::array<double*, 4>> outputs;
+};
+
+}
+
+/* Constants Declarations */
+
+/* The number of entities in each block. It's fixed rather than depending on
+ * the number of threads, since that would change the order of the sums. */
+static const size_t block_size = 4096;
+
+/* Function Declarations */
+
+/* These are the calculators that we will be using for the engines. */
+static void calculator(void* arg);
+static void combiner(void* arg);
+
+/* This combines the results for two blocks of a column. */
+static partial_t combine(const partial_t& a, const partial_t& b);
+
+/* Function Definitions */
+
+std::list<libSphysl::engine_t> libSphysl::statistics::reductions(
+	libSphysl::sandbox_t* s, const std::list<std::string>& columns
+){
+	/* The engines we're generating; one to reduce the blocks and one to
+	 * combine their results. */
+	libSphysl::engine_t reducers, combiners;
+
+	reducers.calculator = calculator;
+	reducers.destructor = libSphysl::utility::destructor<arg_t>;
+
+	combiners.calculator = combiner;
+	combiners.destructor = libSphysl::utility::destructor<combine_arg_t>;
+
+	/* If the database is changed, we are regenerated the same way. */
+	reducers.generator = [columns](libSphysl::sandbox_t* s) {
+		return libSphysl::statistics::reductions(s, columns);
+	};
+
+	reducers.span = 2;
+
+	/* Get the variables we need from the config. */
+	const auto count = std::get<size_t>(s -> config_get("entity count"));
+
+	/* Check the columns and set up the config values for them. */
+	auto combine = new combine_arg_t{
+		count, (count + block_size - 1) / block_size, {}, {}
+	};
+
+	combine -> partials.resize(combine -> blocks * columns.size());
+
+	for(const auto& id: columns) {
+		if(!s -> axes.count(id) && !std::holds_alternative<
+			libSphysl::column_t<double>
+		>(s -> database_get(id))) {
+			delete combine;
+
+			throw std::invalid_argument(
+				"can't reduce non-double column '" + id + "'"
+			);
+		}
+
+		std::array<double*, 4> outputs;
+		size_t i = 0;
+
+		for(const auto& name: {"minimum", "maximum", "sum", "mean"}) {
+			const auto key = id + " " + name;
+
+			auto& value = s -> config[key];
+			if(!std::holds_alternative<double>(value)) value = 0.0;
+			outputs[i++] = &std::get<double>(value);
+		}
+
+		combine -> outputs.push_back(outputs);
+	}
+
+	/* Split the entities into blocks, one per arg. */
+	for(size_t i = 0; i < combine -> blocks; i++) {
+		const auto start = i * block_size;
+		const auto stop = std::min(start + block_size, count);
+
+		auto arg = new arg_t{
+			{}, stop - start, &combine -> partials[i],
+			combine -> blocks
+		};
+
+		for(const auto& id: columns) arg -> columns.push_back(
+			libSphysl::utility::get_axis(s, id, start, stop)
+		);
+
+		reducers.args.push_back(reinterpret_cast<void*>(arg));
+	}
+
+	combiners.args.push_back(reinterpret_cast<void*>(combine));
+	return {reducers, combiners};
+}
+
+static void calculator(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto partial = data.partials;
+
+	for(const auto& column: data.columns) {
+		partial_t result{
+			std::numeric_limits<double>::infinity(),
+			-std::numeric_limits<double>::infinity(), 0.0
+		};
+
+		for(size_t i = 0; i < data.count; i++) {
+			const auto value = column[i];
+
+			result.minimum = std::min(result.minimum, value);
+			result.maximum = std::max(result.maximum, value);
+			result.sum += value;
+		}
+
+		*partial = result;
+		partial += data.stride;
+	}
+}
+
+static void combiner(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<combine_arg_t*>(arg);
+	auto partials = data.partials.data();
+
+	for(const auto& outputs: data.outputs) {
+		/* Combine neighbouring blocks, then neighbouring pairs of
+		 * blocks and so on, until the first block has everything. */
+		for(size_t step = 1; step < data.blocks; step *= 2) {
+			const auto stride = 2 * step;
+
+			for(size_t i = 0; i + step < data.blocks; i += stride) {
+				partials[i] = combine(
+					partials[i], partials[i + step]
+				);
+			}
+		}
+
+		partial_t result{
+			std::numeric_limits<double>::infinity(),
+			-std::numeric_limits<double>::infinity(), 0.0
+		};
+
+		if(data.blocks) result = partials[0];
+
+		*outputs[0] = result.minimum;
+		*outputs[1] = result.maximum;
+		*outputs[2] = result.sum;
+		*outputs[3] = result.sum / data.count;
+
+		partials += data.blocks;
+	}
+}
+
+static partial_t combine(const partial_t& a, const partial_t& b) {
+	return {
+		std::min(a.minimum, b.minimum), std::max(a.maximum, b.maximum),
+		a.sum + b.sum
+	};
+}
@@ -0,0 +1,177 @@
+/* The Sphysl Project Copyright (C) 2022 Jyothiraditya Nellakra
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>. */
+
+/* Including Standard Libraries */
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/* Including System Headerfiles */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Including Library Headerfiles */
+
+#include <libSphysl.h>
+
+/* Constants Declarations */
+
+static const size_t small_page = size_t{1} << 12; // 4 KiB
+static const size_t huge_page = size_t{1} << 21; // 2 MiB
+
+/* Function Declarations */
+
+/* This rounds the number of bytes up to a whole number of pages. */
+static size_t round_up(size_t bytes, size_t page);
+
+/* These map memory of the given (rounded) size, returning nullptr if the kernel
+ * won't give it to us. map_file() backs it with a file in the directory. */
+static void* map_small(size_t bytes);
+static void* map_transparent(size_t bytes);
+static void* map_huge(size_t bytes);
+static void* map_file(size_t bytes, const std::string& directory);
+
+/* Function Definitions */
+
+void* libSphysl::storage_t::allocate(size_t bytes) const {
+	/* Small allocations and the default policy just use the heap. */
+	if(this -> policy == heap_memory || bytes < this -> threshold) {
+		return ::operator new(bytes);
+	}
+
+	void* memory = nullptr;
+
+	switch(this -> policy) {
+	case huge_pages:
+		memory = map_huge(round_up(bytes, huge_page));
+		if(memory) break;
+
+		/* Fall back to transparent huge pages if there aren't any
+		 * reserved huge pages left. */
+		[[fallthrough]];
+
+	case transparent_huge_pages:
+		memory = map_transparent(round_up(bytes, huge_page));
+		break;
+
+	case file_memory:
+		memory = map_file(
+			round_up(bytes, small_page), this -> directory
+		);
+		break;
+
+	default:
+		memory = map_small(round_up(bytes, small_page));
+		break;
+	}
+
+	if(!memory) throw std::bad_alloc{};
+	return memory;
+}
+
+void libSphysl::storage_t::deallocate(void* memory, size_t bytes) const {
+	/* This has to mirror the decisions made by allocate() exactly. */
+	if(this -> policy == heap_memory || bytes < this -> threshold) {
+		::operator delete(memory);
+		return;
+	}
+
+	/* Unmapping has to cover the whole mapping, which is rounded up to
+	 * the kind of pages it was made out of. The huge_pages policy always
+	 * rounds to huge pages, even if it fell back to transparent ones. */
+	const auto small = this -> policy == mapped_memory
+		|| this -> policy == file_memory;
+
+	munmap(memory, round_up(bytes, small? small_page: huge_page));
+}
+
+static size_t round_up(size_t bytes, size_t page) {
+	return (bytes + page - 1) / page * page;
+}
+
+static void* map_small(size_t bytes) {
+	void* memory = mmap(
+		nullptr, bytes, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+	);
+
+	return memory == MAP_FAILED? nullptr: memory;
+}
+
+static void* map_transparent(size_t bytes) {
+	/* mmap() only promises 4 KiB alignment, so we map an extra huge page
+	 * and then trim the ends off so that the mapping starts on a 2 MiB
+	 * boundary; otherwise the kernel can't use huge pages for it. */
+	auto memory = static_cast<char*>(map_small(bytes + huge_page));
+	if(!memory) return nullptr;
+
+	const auto address = reinterpret_cast<std::uintptr_t>(memory);
+	const auto offset = round_up(address, huge_page) - address;
+
+	if(offset) munmap(memory, offset);
+	munmap(memory + offset + bytes, huge_page - offset);
+	memory += offset;
+
+#ifdef MADV_HUGEPAGE
+	/* This is only a hint, so it doesn't matter if it fails. */
+	madvise(memory, bytes, MADV_HUGEPAGE);
+#endif
+
+	return memory;
+}
+
+static void* map_huge(size_t bytes) {
+#ifdef MAP_HUGETLB
+	void* memory = mmap(
+		nullptr, bytes, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0
+	);
+
+	return memory == MAP_FAILED? nullptr: memory;
+#else
+	(void) bytes; return nullptr;
+#endif
+}
+
+static void* map_file(size_t bytes, const std::string& directory) {
+	/* Create a file of the right size to back the column. Its name is
+	 * only needed until it's open, so it's unlinked straight away. */
+	std::string path = directory + "/libSphysl-XXXXXX";
+	const int fd = mkstemp(path.data());
+	if(fd == -1) return nullptr;
+
+	unlink(path.c_str());
+
+	if(ftruncate(fd, bytes) == -1) {
+		close(fd); return nullptr;
+	}
+
+	/* The mapping keeps the file alive, so we don't need the descriptor
+	 * anymore once we have it. */
+	void* memory = mmap(
+		nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0
+	);
+
+	close(fd);
+	if(memory == MAP_FAILED) return nullptr;
+
+	/* Columns are read in order, so the kernel should read ahead a lot
+	 * and drop pages behind us. This is only a hint as well. */
+	madvise(memory, bytes, MADV_SEQUENTIAL);
+	return memory;
+}
@@ -24,6 +24,10 @@
 
 /* Structure Declarations */
 
+/* Every source file has its own arg_t, so they're kept in an anonymous
+ * namespace to stop the linker from merging their destructor<arg_t>'s. */
+namespace {
+
 /* This is the argument that's gonig to be passed to the calculator. */
 struct arg_t {
 	/* The simulation data we are in charge of. */
@@ -39,6 +43,8 @@ struct arg_t {
 	const double &min, &max;
 };
 
+}
+
 /* Function definitions */
 
 /* The engines do fairly similar things, so to avoid source code duplication we
@@ -13,10 +13,94 @@
  * You should have received a copy of the GNU General Public License along with
  * this program. If not, see <https://www.gnu.org/licenses/>. */
 
+/* Including Standard Libraries */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
 /* Including Library Headerfiles */
 
 #include <libSphysl/utility.h>
 
+/* Structure Declarations */
+
+/* Every source file has its own arg_t, so they're kept in an anonymous
+ * namespace to stop the linker from merging their destructor<arg_t>'s. */
+namespace {
+
+/* This is the argument that's going to be passed to reduce_forces()'s
+ * calculator, one for each range of entities. */
+struct arg_t {
+	std::shared_ptr<libSphysl::utility::forces_t> forces;
+	size_t start, stop; // The entities we're adding up.
+
+	libSphysl::utility::slice_t<double> F_x, F_y, F_z; // Forces.
+};
+
+/* This is everything that update_neighbours()'s stages share. */
+struct lists_t {
+	std::shared_ptr<libSphysl::utility::neighbours_t> neighbours;
+	libSphysl::utility::slice_t<double> x, y, z; // Positions.
+
+	/* The ranges of entities each thread goes through, whether any of
+	 * the entities in each range have moved too far, and whether the
+	 * list is being built again this tick. */
+	std::vector<std::pair<size_t, size_t>> ranges;
+	std::vector<char> moved;
+	bool rebuild;
+
+	/* Where the entities were when the list was last built. */
+	std::vector<libSphysl::vec3_t> origins;
+
+	/* The side of the grid's cells, and the entities with the keys of
+	 * their cells, sorted by them. The cells that have entities in them
+	 * are listed in order of their keys, and the entities in the cth of
+	 * them are the ones in members from starts[c] up to starts[c + 1]. */
+	double side;
+
+	std::vector<std::pair<uint64_t, size_t>> sorted;
+	std::vector<uint64_t> cells;
+	std::vector<size_t> starts, members;
+
+	/* The entities are gone through in the order of their keys, with
+	 * each thread taking a range of them. These are the number of
+	 * neighbours that each of the entities in each range has, and the
+	 * neighbours themselves, before they're put back in order. */
+	std::vector<std::vector<size_t>> counts, found;
+};
+
+/* There's one of these for every thread in every one of update_neighbours()'s
+ * stages, and the stages that can't be split up just have the one. */
+struct list_arg_t {
+	std::shared_ptr<lists_t> lists;
+	size_t range; // Index of our range in the ranges.
+};
+
+}
+
+/* Constants Declarations */
+
+/* The grid's keys are the coordinates of the cells along x, y and z, from the
+ * least significant bits up, with 21 bits each. */
+static const size_t bits = 21;
+static const uint64_t mask = (uint64_t{1} << bits) - 1;
+
+/* Function Declarations */
+
+/* This is the calculator that we will be using for reduce_forces(). */
+static void reducer(void* arg);
+
+/* These are the calculators for update_neighbours()'s stages, in the order
+ * that they run. The checker sees whether anything has moved too far, and
+ * the rest only do anything if it has. */
+static void checker(void* arg);
+static void binner(void* arg);
+static void lister(void* arg);
+static void joiner(void* arg);
+
 /* Function Definitions */
 
 libSphysl::utility::vector_t::vector_t(double x, double y, double z):
@@ -111,6 +195,30 @@ libSphysl::utility::vector_t::proj(const vector_t& v) const{
 	}
 }
 
+libSphysl::utility::slice_t<double> libSphysl::utility::get_axis(
+	libSphysl::sandbox_t* s, const std::string& id,
+	size_t start, size_t stop
+){
+	/* If the axis is its own column, slice it like any other. */
+	if(!s -> axes.count(id)) return slice_t<double>(
+		std::get<libSphysl::column_t<double>>(s -> database_get(id)),
+		start, stop
+	);
+
+	/* Otherwise, find the packed column and the component we want. */
+	const auto& [packed, axis] = s -> axes.at(id);
+	auto& vec3s = std::get<libSphysl::column_t<libSphysl::vec3_t>>(
+		s -> database.at(packed)
+	);
+
+	/* vec3_t is three doubles without padding, so stepping through one
+	 * axis means stepping three doubles at a time. */
+	static_assert(sizeof(libSphysl::vec3_t) == 3 * sizeof(double));
+	auto base = reinterpret_cast<double*>(vec3s.data()) + axis;
+
+	return slice_t<double>(base, 3, start, stop);
+}
+
 void libSphysl::utility::null_calculator(void* arg) {
 	(void) arg; // Do nothing.
 }
@@ -128,20 +236,6 @@ double libSphysl::utility::random(const double min, const double max) {
 	return distribution(engine); // Return the random number.
 }
 
-void libSphysl::utility::randomise(
-	std::vector<double>& v, const double min, const double max
-){
-	std::random_device device; // Random data generator.
-	std::mt19937 engine{device()}; // Random number generator.
-	std::uniform_real_distribution<double> distribution(min, max);
-	// Distribution generator.
-
-	/* Loop over the vector and set all the values to random ones. */
-	for(auto &i: v) {
-		i = distribution(engine);
-	}
-}
-
 std::vector<std::pair<size_t, size_t>> libSphysl::utility::divide_range(
 	const size_t start, const size_t stop, const size_t divisions
 ){
@@ -278,4 +372,400 @@ void libSphysl::utility::get_combinations_exclusive(
 		combinations = leftovers;
 		used = std::vector<bool>(total, false);
 	}
-}
\ No newline at end of file
+}
+
+std::shared_ptr<libSphysl::utility::forces_t> libSphysl::utility::make_forces(
+	libSphysl::sandbox_t* s
+){
+	const auto count = std::get<size_t>(s -> config_get("entity count"));
+	const auto threads = s -> threads.size(); // Not stored in config.
+
+	/* No partitions means one for each thread. */
+	auto partitions = std::get<size_t>(
+		s -> config_get("force partitions")
+	);
+
+	if(!partitions) partitions = std::max(threads, size_t{1});
+
+	return std::make_shared<forces_t>(forces_t{
+		count, partitions, libSphysl::column_t<libSphysl::vec3_t>(
+			count * partitions, libSphysl::vec3_t{0.0, 0.0, 0.0},
+			s -> storage
+		)
+	});
+}
+
+libSphysl::engine_t libSphysl::utility::reduce_forces(
+	libSphysl::sandbox_t* s, const std::shared_ptr<forces_t>& forces
+){
+	/* The engine we're generating. It's regenerated along with the engine
+	 * that's using the forces_t, so it doesn't need a generator. */
+	libSphysl::engine_t engine;
+
+	engine.calculator = reducer;
+	engine.destructor = libSphysl::utility::destructor<arg_t>;
+
+	/* Each entity's copies are added up in the same order, so it doesn't
+	 * matter how the entities are split between the threads. */
+	const auto ranges = divide_range(
+		0, forces -> count, s -> threads.size()
+	);
+
+	for(const auto& [start, stop]: ranges) {
+		if(start == stop) continue;
+
+		auto arg = new arg_t{
+			forces, start, stop,
+			get_axis(s, "x force", start, stop),
+			get_axis(s, "y force", start, stop),
+			get_axis(s, "z force", start, stop)
+		};
+
+		engine.args.push_back(reinterpret_cast<void*>(arg));
+	}
+
+	return engine;
+}
+
+static void reducer(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<arg_t*>(arg);
+	auto& forces = *data.forces;
+
+	for(size_t i = data.start; i < data.stop; i++) {
+		libSphysl::vec3_t F{0.0, 0.0, 0.0};
+
+		for(size_t j = 0; j < forces.partitions; j++) {
+			auto& partial = forces.partition(j)[i];
+
+			F.x += partial.x; F.y += partial.y; F.z += partial.z;
+			partial = {0.0, 0.0, 0.0};
+		}
+
+		const auto k = i - data.start;
+		data.F_x[k] += F.x; data.F_y[k] += F.y; data.F_z[k] += F.z;
+	}
+}
+
+std::shared_ptr<libSphysl::utility::neighbours_t>
+libSphysl::utility::make_neighbours(
+	libSphysl::sandbox_t* s, double cutoff, double skin
+){
+	if(!(cutoff > 0.0)) throw std::invalid_argument(
+		"the cutoff of a neighbour list has to be positive"
+	);
+
+	if(!(skin >= 0.0)) throw std::invalid_argument(
+		"the skin of a neighbour list can't be negative"
+	);
+
+	const auto count = std::get<size_t>(s -> config_get("entity count"));
+
+	return std::make_shared<neighbours_t>(neighbours_t{
+		count, cutoff, skin, std::vector<size_t>(count + 1, 0), {}, 0
+	});
+}
+
+std::list<libSphysl::engine_t> libSphysl::utility::update_neighbours(
+	libSphysl::sandbox_t* s, const std::shared_ptr<neighbours_t>& neighbours
+){
+	/* The list is built again on the first tick, since the entities may
+	 * have been moved around in the meantime. */
+	const auto count = neighbours -> count;
+	neighbours -> builds = 0;
+
+	auto lists = std::make_shared<lists_t>(lists_t{
+		neighbours,
+		get_axis(s, "x position", 0, count),
+		get_axis(s, "y position", 0, count),
+		get_axis(s, "z position", 0, count),
+		{}, {}, false, std::vector<libSphysl::vec3_t>(count), 0.0,
+		std::vector<std::pair<uint64_t, size_t>>(count),
+		{}, {}, {}, {}, {}
+	});
+
+	/* Give each thread its own range of entities. */
+	for(const auto& range: divide_range(0, count, s -> threads.size())) {
+		if(range.first == range.second) continue;
+		lists -> ranges.push_back(range);
+	}
+
+	const auto ranges = lists -> ranges.size();
+
+	lists -> moved.resize(ranges);
+	lists -> counts.resize(ranges);
+	lists -> found.resize(ranges);
+
+	/* Set up the engines for the stages. The ones that run in parallel
+	 * get an arg for every range, and the rest get just the one. They're
+	 * regenerated along with the engine that's using the list, so they
+	 * don't need a generator. */
+	std::list<libSphysl::engine_t> engines;
+
+	for(const auto calculator: {checker, binner, lister, joiner}) {
+		libSphysl::engine_t engine;
+
+		engine.calculator = calculator;
+		engine.destructor = destructor<list_arg_t>;
+
+		const auto parallel = calculator == checker
+			|| calculator == lister;
+
+		for(size_t i = 0; i < (parallel? ranges: 1); i++) {
+			auto arg = new list_arg_t{lists, i};
+			engine.args.push_back(reinterpret_cast<void*>(arg));
+		}
+
+		engines.push_back(engine);
+	}
+
+	return engines;
+}
+
+static void checker(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<list_arg_t*>(arg);
+	auto& lists = *data.lists;
+	const auto& neighbours = *lists.neighbours;
+
+	/* Nothing can have moved too far if the list's never been built. */
+	auto& moved = lists.moved[data.range];
+	moved = !neighbours.builds;
+
+	const auto limit = 0.25 * neighbours.skin * neighbours.skin;
+	const auto [start, stop] = lists.ranges[data.range];
+
+	for(auto i = start; i < stop && !moved; i++) {
+		const auto& origin = lists.origins[i];
+
+		const auto d_x = lists.x[i] - origin.x;
+		const auto d_y = lists.y[i] - origin.y;
+		const auto d_z = lists.z[i] - origin.z;
+
+		moved = d_x * d_x + d_y * d_y + d_z * d_z > limit;
+	}
+}
+
+static void binner(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& lists = *reinterpret_cast<list_arg_t*>(arg) -> lists;
+	const auto& neighbours = *lists.neighbours;
+
+	lists.rebuild = std::find(
+		lists.moved.begin(), lists.moved.end(), true
+	) != lists.moved.end();
+
+	if(!lists.rebuild) return;
+
+	/* With no entities, there are no cells either. */
+	const auto count = neighbours.count;
+
+	if(!count) {
+		lists.cells.clear();
+		lists.starts.assign(1, 0);
+		lists.members.clear();
+		return;
+	}
+
+	/* Work out the bounds of the entities, starting from the first. */
+	libSphysl::vec3_t min{lists.x[0], lists.y[0], lists.z[0]}, max = min;
+
+	for(size_t i = 1; i < count; i++) {
+		min.x = std::min(min.x, lists.x[i]);
+		min.y = std::min(min.y, lists.y[i]);
+		min.z = std::min(min.z, lists.z[i]);
+
+		max.x = std::max(max.x, lists.x[i]);
+		max.y = std::max(max.y, lists.y[i]);
+		max.z = std::max(max.z, lists.z[i]);
+	}
+
+	/* The cells are as wide as the cutoff plus the skin, unless the
+	 * entities are so spread out that their coordinates wouldn't fit
+	 * into the keys otherwise. */
+	const auto span = std::max({
+		max.x - min.x, max.y - min.y, max.z - min.z
+	});
+
+	lists.side = std::max(
+		neighbours.cutoff + neighbours.skin, span / double(mask)
+	);
+
+	/* Work out each entity's key, and sort them by their keys, which
+	 * keeps the entities in each cell in order. */
+	for(size_t i = 0; i < count; i++) {
+		const auto key = [&](double p, double corner) {
+			return std::min(
+				uint64_t((p - corner) / lists.side), mask
+			);
+		};
+
+		lists.sorted[i] = {
+			key(lists.z[i], min.z) << (2 * bits)
+				| key(lists.y[i], min.y) << bits
+				| key(lists.x[i], min.x),
+			i
+		};
+	}
+
+	std::sort(lists.sorted.begin(), lists.sorted.end());
+
+	/* List the cells with entities in them. */
+	lists.cells.clear();
+	lists.starts.clear();
+	lists.members.resize(count);
+
+	for(size_t k = 0; k < count; k++) {
+		const auto& [key, i] = lists.sorted[k];
+
+		if(lists.cells.empty() || lists.cells.back() != key) {
+			lists.cells.push_back(key);
+			lists.starts.push_back(k);
+		}
+
+		lists.members[k] = i;
+	}
+
+	lists.starts.push_back(count);
+}
+
+static void lister(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& data = *reinterpret_cast<list_arg_t*>(arg);
+	auto& lists = *data.lists;
+	const auto& neighbours = *lists.neighbours;
+
+	if(!lists.rebuild) return;
+
+	const auto reach = neighbours.cutoff + neighbours.skin;
+	const auto reach_sq = reach * reach;
+
+	const auto [start, stop] = lists.ranges[data.range];
+	auto& counts = lists.counts[data.range];
+	auto& found = lists.found[data.range];
+
+	counts.assign(stop - start, 0);
+	found.clear();
+
+	/* Each entity is compared with the ones after it in its own cell and
+	 * the cells around it, which are in nine rows along x. The cells in
+	 * a row are next to each other in the list of cells, and since the
+	 * entities are gone through in the order of their keys, the rows
+	 * only ever move forwards through the list, so each row is found by
+	 * moving a cursor along. */
+	const auto& cells = lists.cells;
+
+	std::array<size_t, 9> cursors;
+	std::array<bool, 9> started{};
+	std::array<std::pair<size_t, size_t>, 9> rows;
+
+	const auto find = [&](size_t r, uint64_t key) {
+		const auto x = key & mask, y = key >> bits & mask;
+		const auto z = key >> (2 * bits);
+
+		const auto d_z = int(r / 3) - 1, d_y = int(r % 3) - 1;
+		rows[r] = {0, 0};
+
+		if((d_z < 0 && !z) || (d_z > 0 && z == mask)) return;
+		if((d_y < 0 && !y) || (d_y > 0 && y == mask)) return;
+
+		const auto row = (z + d_z) << (2 * bits) | (y + d_y) << bits;
+		const auto low = row | (x? x - 1: 0);
+		const auto high = row | std::min(x + 1, mask);
+
+		/* The cursors start wherever their rows first are. */
+		auto& cursor = cursors[r];
+
+		if(!started[r]) cursor = std::lower_bound(
+			cells.begin(), cells.end(), low
+		) - cells.begin();
+
+		started[r] = true;
+
+		while(cursor < cells.size() && cells[cursor] < low) cursor++;
+
+		auto end = cursor;
+		while(end < cells.size() && cells[end] <= high) end++;
+
+		rows[r] = {lists.starts[cursor], lists.starts[end]};
+	};
+
+	for(auto k = start; k < stop; k++) {
+		const auto [key, i] = lists.sorted[k];
+
+		if(k == start || key != lists.sorted[k - 1].first) {
+			for(size_t r = 0; r < 9; r++) find(r, key);
+		}
+
+		const libSphysl::vec3_t p{lists.x[i], lists.y[i], lists.z[i]};
+		lists.origins[i] = p;
+
+		const auto first = found.size();
+
+		for(const auto& [from, to]: rows) {
+			for(auto m = from; m < to; m++) {
+				const auto j = lists.members[m];
+				if(j <= i) continue;
+
+				const auto d_x = lists.x[j] - p.x;
+				const auto d_y = lists.y[j] - p.y;
+				const auto d_z = lists.z[j] - p.z;
+
+				const auto d_sq = d_x * d_x + d_y * d_y
+					+ d_z * d_z;
+
+				if(d_sq < reach_sq) found.push_back(j);
+			}
+		}
+
+		std::sort(found.begin() + first, found.end());
+		counts[k - start] = found.size() - first;
+	}
+}
+
+static void joiner(void* arg) {
+	/* Get a reference to our cached data by casting the argument. */
+	auto& lists = *reinterpret_cast<list_arg_t*>(arg) -> lists;
+	auto& neighbours = *lists.neighbours;
+
+	if(!lists.rebuild) return;
+
+	/* Count up where each entity's neighbours start, and then put them
+	 * back in the order of the entities. */
+	auto& offsets = neighbours.offsets;
+
+	for(size_t r = 0; r < lists.ranges.size(); r++) {
+		const auto start = lists.ranges[r].first;
+		const auto& counts = lists.counts[r];
+
+		for(size_t k = 0; k < counts.size(); k++) {
+			offsets[lists.members[start + k] + 1] = counts[k];
+		}
+	}
+
+	for(size_t i = 0; i < neighbours.count; i++) {
+		offsets[i + 1] += offsets[i];
+	}
+
+	neighbours.indices.resize(offsets[neighbours.count]);
+
+	for(size_t r = 0; r < lists.ranges.size(); r++) {
+		const auto start = lists.ranges[r].first;
+		const auto& counts = lists.counts[r];
+
+		auto from = lists.found[r].begin();
+
+		for(size_t k = 0; k < counts.size(); k++) {
+			const auto i = lists.members[start + k];
+
+			std::copy(
+				from, from + counts[k],
+				neighbours.indices.begin() + offsets[i]
+			);
+
+			from += counts[k];
+		}
+	}
+
+	neighbours.builds++;
+}